@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2015, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Render cost benchmark: the face is compiled as-is against the host
+ * shim, then driven through a simulated day of events while the shim
+ * counts drawing primitives, pixels and frame buffer copies (memcpy and
+ * memset while the frame buffer is captured).
+ */
+
+#include <stdio.h>
+
+#include "pebble.h"
+
+#define BENCH_EPOCH 1768471740	/* 2026-01-15 10:09:00 UTC */
+
+static time_t bench_now = BENCH_EPOCH;
+
+static time_t
+bench_time(time_t *tloc) {
+	if (tloc) *tloc = bench_now;
+	return bench_now;
+}
+
+/* lets the simulated time pass, firing the face timers on the way */
+static void
+bench_advance(unsigned seconds) {
+	bench_now += seconds;
+	shim_advance(seconds * 1000);
+}
+
+#define main classic_lite_main
+#define memcpy(dest, src, n) shim_memcpy((dest), (src), (n))
+#define memset(dest, c, n) shim_memset((dest), (c), (n))
+#define time(tloc) bench_time(tloc)
+#include "../src/classic-lite.c"
+#undef time
+#undef memset
+#undef memcpy
+#undef main
+
+struct event_cost {
+	const char *name;
+	unsigned long count;
+	struct shim_stats total;
+	unsigned long changed;
+};
+
+static struct shim_stats before;
+static uint8_t *previous_screen;
+
+static void
+event_begin(void) {
+	shim_render();
+	before = shim_stats;
+	memcpy(previous_screen, shim_frame_buffer(), shim_frame_buffer_size());
+}
+
+static void
+event_end(struct event_cost *cost) {
+	const unsigned long *b = (const unsigned long *)&before;
+	const unsigned long *a = (const unsigned long *)&shim_stats;
+	unsigned long *t = (unsigned long *)&cost->total;
+	const uint8_t *screen = shim_frame_buffer();
+	size_t i;
+
+	for (i = 0; i < sizeof shim_stats / sizeof *a; i += 1)
+		t[i] += a[i] - b[i];
+	for (i = 0; i < shim_frame_buffer_size(); i += 1)
+		if (screen[i] != previous_screen[i]) cost->changed += 1;
+	cost->count += 1;
+}
+
+static void
+report(const struct event_cost *cost) {
+	const struct shim_stats *s = &cost->total;
+	double n = cost->count ? cost->count : 1;
+	unsigned long primitives = s->lines + s->pixel_calls + s->rects
+	    + s->circles + s->path_fills + s->path_outlines + s->texts
+	    + s->bitmaps;
+
+	printf("  %-16s %5lu %6.2f %7.2f %7.2f %8.1f %9.1f %6.2f %9.1f %8.1f"
+	    " %5.2f %6.1f %5.2f\n",
+	    cost->name, cost->count, s->wakeups / n,
+	    s->frames / n, s->layer_updates / n, primitives / n,
+	    s->pixels / n, s->captures / n, s->bytes_copied / n,
+	    cost->changed / n, s->persist_writes / n, s->persist_bytes / n,
+	    s->vibrations / n);
+}
+
+/* the packed configuration the phone sends for the default settings */
+static void
+send_config(void) {
+	uint8_t buffer[128], packed[PERSIST_BUFFER_SIZE];
+	DictionaryIterator iter;
+	struct config config;
+	size_t size;
+
+	get_config(&config);
+	config.background_color = GColorFromHEX(0xFFFFFF);
+	config.battery_color = GColorFromHEX(0x555555);
+	config.bluetooth_color = GColorFromHEX(0x000000);
+	config.hour_mark_color = GColorFromHEX(0x000000);
+	config.inner_rectangle_color = GColorFromHEX(0xAAAAAA);
+	config.minute_mark_color = GColorFromHEX(0x000000);
+	config.text_color = GColorFromHEX(0x000000);
+	config.battery_color2 = GColorFromHEX(0x555555);
+	config.text_font = 0;
+	strcpy(config.text_format, "%a %d");
+	config.bluetooth_vibration = true;
+	config.show_battery_icon_below = 50;
+	config.hour_hand_color = GColorFromHEX(0x000000);
+	config.minute_hand_color = GColorFromHEX(0x000000);
+	config.pin_color = GColorFromHEX(0x000000);
+	size = encode_config(&config, packed);
+
+	shim_dict_init(&iter, buffer, sizeof buffer);
+	shim_dict_add_data(&iter, 23, packed, size);
+	shim_inbox(&iter);
+}
+
+static void
+send_governor_config(uint8_t quiet_start, uint8_t quiet_end, uint8_t idle) {
+	uint8_t buffer[64];
+	DictionaryIterator iter;
+
+	shim_dict_init(&iter, buffer, sizeof buffer);
+	shim_dict_add_uint(&iter, 14, quiet_start);
+	shim_dict_add_uint(&iter, 15, quiet_end);
+	shim_dict_add_uint(&iter, 16, idle);
+	shim_inbox(&iter);
+}
+
+static void
+send_seconds_config(uint8_t duration) {
+	uint8_t buffer[64];
+	DictionaryIterator iter;
+
+	shim_dict_init(&iter, buffer, sizeof buffer);
+	shim_dict_add_uint(&iter, 17, duration);
+	shim_inbox(&iter);
+}
+
+static void
+send_bluetooth_config(uint8_t hysteresis, uint8_t vibrations_per_hour) {
+	uint8_t buffer[64];
+	DictionaryIterator iter;
+
+	shim_dict_init(&iter, buffer, sizeof buffer);
+	shim_dict_add_uint(&iter, 18, hysteresis);
+	shim_dict_add_uint(&iter, 19, vibrations_per_hour);
+	shim_inbox(&iter);
+}
+
+/* a day or night theme stored as a preset, switched by double taps */
+static void
+send_preset(uint8_t slot, bool night) {
+	uint8_t buffer[128], packed[PERSIST_BUFFER_SIZE];
+	DictionaryIterator iter;
+	struct config config;
+	size_t size;
+
+	get_config(&config);
+	config.preset_switching = PRESETS_ON_DOUBLE_TAP;
+	config.background_color = night ? GColorBlack : GColorWhite;
+	config.minute_mark_color = night ? GColorWhite : GColorBlack;
+	config.hour_mark_color = night ? GColorWhite : GColorBlack;
+	config.hour_hand_color = night ? GColorWhite : GColorBlack;
+	config.minute_hand_color = night ? GColorWhite : GColorBlack;
+	config.pin_color = night ? GColorWhite : GColorBlack;
+	config.text_color = night ? GColorWhite : GColorBlack;
+	config.bluetooth_color = night ? GColorWhite : GColorBlack;
+	config.text_font = night ? 1 : 0;
+	size = encode_config(&config, packed);
+
+	shim_dict_init(&iter, buffer, sizeof buffer);
+	shim_dict_add_data(&iter, 23, packed, size);
+	shim_dict_add_uint(&iter, 26, slot);
+	shim_inbox(&iter);
+}
+
+/* the phone asking for the energy counters and frame timings */
+static void
+request_statistics(void) {
+	uint8_t buffer[32];
+	DictionaryIterator iter;
+
+	shim_dict_init(&iter, buffer, sizeof buffer);
+	shim_dict_add_uint(&iter, 24, 1);
+	shim_dict_add_uint(&iter, 25, 1);
+	shim_inbox(&iter);
+}
+
+/* the counters the face persisted, as the phone would receive them */
+static void
+report_counters(void) {
+	static const char *const names[COUNTER_NUMBER] = {
+		"frames", "marks", "icons", "text", "hands", "seconds", "pin",
+		"hits", "misses", "saves", "writes", "vibes", "toggles",
+	};
+	uint32_t counters[COUNTER_NUMBER] = { 0 };
+	int i;
+
+	persist_read_data(COUNTERS_KEY, counters, sizeof counters);
+	printf("  counters:");
+	for (i = 0; i < COUNTER_NUMBER; i += 1)
+		printf(" %s %lu", names[i], (unsigned long)counters[i]);
+	printf("\n");
+}
+
+int
+main(void) {
+	struct event_cost launch = { .name = "init" };
+	struct event_cost minute = { .name = "minute tick" };
+	struct event_cost hour = { .name = "hour tick" };
+	struct event_cost day = { .name = "day tick" };
+	struct event_cost battery = { .name = "battery -1%" };
+	struct event_cost bt_off = { .name = "bluetooth off" };
+	struct event_cost bt_on = { .name = "bluetooth on" };
+	struct event_cost config = { .name = "config message" };
+	struct event_cost governed = { .name = "governed minute" };
+	struct event_cost tap = { .name = "tap wake" };
+	struct event_cost seconds_tap = { .name = "seconds tap" };
+	struct event_cost second = { .name = "seconds tick" };
+	struct event_cost flap = { .name = "bluetooth flap" };
+	struct event_cost outage = { .name = "bluetooth outage" };
+	struct event_cost statistics = { .name = "stats request" };
+	struct event_cost relaunch = { .name = "relaunch" };
+	struct event_cost preset = { .name = "preset switch" };
+	struct tm tick_time;
+	struct event_cost *cost;
+	int i;
+
+	setenv("TZ", "UTC", 1);
+	tzset();
+	shim_render();
+	previous_screen = malloc(shim_frame_buffer_size());
+
+	event_begin();
+	init();
+	shim_render();
+	event_end(&launch);
+
+	/* one simulated day, classified by the largest unit changed */
+	for (i = 0; i < 24 * 60; i += 1) {
+		bench_now += 60;
+		tick_time = *localtime(&bench_now);
+		cost = (tick_time.tm_hour == 0 && tick_time.tm_min == 0) ? &day
+		    : (tick_time.tm_min == 0) ? &hour : &minute;
+		event_begin();
+		shim_tick(&tick_time);
+		event_end(cost);
+	}
+
+	for (i = 99; i >= 0; i -= 1) {
+		event_begin();
+		shim_set_battery(i);
+		event_end(&battery);
+	}
+
+	for (i = 0; i < 10; i += 1) {
+		event_begin();
+		shim_set_connection(false);
+		event_end(&bt_off);
+		event_begin();
+		shim_set_connection(true);
+		event_end(&bt_on);
+	}
+
+	for (i = 0; i < 10; i += 1) {
+		event_begin();
+		send_config();
+		event_end(&config);
+	}
+
+	/*
+	 * Another day with quiet hours from 23:00 to 7:00 and a 10 minute
+	 * idle timeout, the wrist moving during the first third of each
+	 * waking hour and a tap in the middle of the night.
+	 */
+	send_governor_config(23, 7, 10);
+	for (i = 0; i < 24 * 60; i += 1) {
+		bench_now += 60;
+		tick_time = *localtime(&bench_now);
+		if (tick_time.tm_hour >= 7 && tick_time.tm_hour < 23
+		    && tick_time.tm_min < 20)
+			shim_set_accel(0, (i % 2) ? 400 : -400, -900);
+		else
+			shim_set_accel(0, 0, -1000);
+
+		if (tick_time.tm_hour == 3 && tick_time.tm_min == 30) {
+			event_begin();
+			shim_tap();
+			event_end(&tap);
+		}
+
+		event_begin();
+		shim_tick(&tick_time);
+		event_end(&governed);
+	}
+
+	/* a 30 second burst of the seconds hand, ticked every second */
+	send_seconds_config(30);
+	for (i = 0; i < 3; i += 1) {
+		event_begin();
+		shim_tap();
+		event_end(&seconds_tap);
+		do {
+			bench_now += 1;
+			tick_time = *localtime(&bench_now);
+			event_begin();
+			shim_tick(&tick_time);
+			event_end(&second);
+		} while (seconds_hand_shown);
+		bench_now += 60;
+	}
+
+	/*
+	 * With a 10 second hysteresis and 2 vibrations per hour: a link
+	 * dropping for 3 seconds every 8 seconds for a few minutes, then
+	 * five real outages of a minute each.
+	 */
+	send_bluetooth_config(10, 2);
+	for (i = 0; i < 20; i += 1) {
+		event_begin();
+		shim_set_connection(false);
+		bench_advance(3);
+		shim_set_connection(true);
+		bench_advance(5);
+		event_end(&flap);
+	}
+	for (i = 0; i < 5; i += 1) {
+		event_begin();
+		shim_set_connection(false);
+		bench_advance(60);
+		shim_set_connection(true);
+		bench_advance(60);
+		event_end(&outage);
+	}
+
+	for (i = 0; i < 10; i += 1) {
+		event_begin();
+		request_statistics();
+		event_end(&statistics);
+	}
+
+	/* two themes stored on the watch, then switched by double taps */
+	send_governor_config(0, 0, 0);
+	send_seconds_config(0);
+	send_preset(2, true);
+	send_preset(1, false);
+	for (i = 0; i < 10; i += 1) {
+		event_begin();
+		shim_tap();
+		bench_advance(1);
+		shim_tap();
+		event_end(&preset);
+		bench_advance(60);
+	}
+
+	/* coming back to the face from an app, its marks being stored */
+	for (i = 0; i < 10; i += 1) {
+		event_begin();
+		deinit();
+		init();
+		shim_render();
+		event_end(&relaunch);
+	}
+
+	deinit();
+
+	printf("%s: %s, frame buffer %zu bytes, inbox %lu bytes, "
+	    "outbox %lu bytes\n",
+	    PBL_IF_RECT_ELSE(PBL_IF_COLOR_ELSE("basalt", "aplite"), "chalk"),
+	    PBL_IF_COLOR_ELSE("8-bit", "1-bit"), shim_frame_buffer_size(),
+	    (unsigned long)shim_inbox_size(),
+	    (unsigned long)shim_outbox_size());
+	printf("  %-16s %5s %6s %7s %7s %8s %9s %6s %9s %8s %5s %6s %5s\n",
+	    "event", "count", "wakes", "frames", "layers", "prims", "pixels",
+	    "fbcap", "copied", "changed", "flash", "fbytes", "vibes");
+	report(&launch);
+	report(&minute);
+	report(&hour);
+	report(&day);
+	report(&battery);
+	report(&bt_off);
+	report(&bt_on);
+	report(&config);
+	report(&governed);
+	report(&tap);
+	report(&seconds_tap);
+	report(&second);
+	report(&flap);
+	report(&outage);
+	report(&statistics);
+	report(&preset);
+	report(&relaunch);
+	report_counters();
+
+	free(previous_screen);
+	return 0;
+}
@@ -0,0 +1,1326 @@
+/*
+ * Copyright (c) 2015, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "pebble.h"
+
+struct shim_stats shim_stats;
+static bool shim_verbose = false;
+
+void
+app_log(uint8_t level, const char *file, int line, const char *fmt, ...) {
+	va_list ap;
+
+	if (!shim_verbose && level > APP_LOG_LEVEL_WARNING) return;
+
+	fprintf(stderr, "[%u] %s:%d: ", (unsigned)level, file, line);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+/*********
+ * SHAPES *
+ *********/
+
+GRect
+grect_inset(GRect rect, GEdgeInsets insets) {
+	rect.origin.x += insets.left;
+	rect.origin.y += insets.top;
+	rect.size.w -= insets.left + insets.right;
+	rect.size.h -= insets.top + insets.bottom;
+	return rect;
+}
+
+GPoint
+grect_center_point(const GRect *rect) {
+	return GPoint(rect->origin.x + rect->size.w / 2,
+	    rect->origin.y + rect->size.h / 2);
+}
+
+bool
+grect_equal(const GRect *a, const GRect *b) {
+	return a->origin.x == b->origin.x && a->origin.y == b->origin.y
+	    && a->size.w == b->size.w && a->size.h == b->size.h;
+}
+
+bool
+grect_contains_point(const GRect *rect, const GPoint *point) {
+	return point->x >= rect->origin.x && point->y >= rect->origin.y
+	    && point->x < rect->origin.x + rect->size.w
+	    && point->y < rect->origin.y + rect->size.h;
+}
+
+bool
+gpoint_equal(const GPoint *a, const GPoint *b) {
+	return a->x == b->x && a->y == b->y;
+}
+
+int32_t
+sin_lookup(int32_t angle) {
+	return (int32_t)lround(sin(angle * 2.0 * M_PI / TRIG_MAX_ANGLE)
+	    * TRIG_MAX_RATIO);
+}
+
+int32_t
+cos_lookup(int32_t angle) {
+	return (int32_t)lround(cos(angle * 2.0 * M_PI / TRIG_MAX_ANGLE)
+	    * TRIG_MAX_RATIO);
+}
+
+/***********
+ * BITMAPS *
+ ***********/
+
+struct GBitmap {
+	GBitmapFormat format;
+	GSize size;
+	uint16_t row_size;
+	uint8_t *data;
+	size_t data_size;
+	int16_t *min_x;
+	int16_t *max_x;
+	size_t *offset;
+};
+
+static GBitmap *
+bitmap_alloc(GSize size, GBitmapFormat format) {
+	GBitmap *result = calloc(1, sizeof *result);
+	result->format = format;
+	result->size = size;
+	result->row_size = (format == GBitmapFormat1Bit)
+	    ? (size.w + 31) / 32 * 4 : size.w;
+	result->data_size = (size_t)result->row_size * size.h;
+	return result;
+}
+
+GBitmap *
+gbitmap_create_blank(GSize size, GBitmapFormat format) {
+	GBitmap *result;
+
+	if (format != GBitmapFormat1Bit && format != GBitmapFormat8Bit)
+		return 0;
+	result = bitmap_alloc(size, format);
+	result->data = calloc(1, result->data_size);
+	return result;
+}
+
+void
+gbitmap_destroy(GBitmap *bitmap) {
+	if (!bitmap) return;
+	free(bitmap->data);
+	free(bitmap);
+}
+
+GRect
+gbitmap_get_bounds(const GBitmap *bitmap) {
+	return GRect(0, 0, bitmap->size.w, bitmap->size.h);
+}
+
+GBitmapFormat
+gbitmap_get_format(const GBitmap *bitmap) {
+	return bitmap->format;
+}
+
+uint8_t *
+gbitmap_get_data(const GBitmap *bitmap) {
+	return bitmap->data;
+}
+
+uint16_t
+gbitmap_get_bytes_per_row(const GBitmap *bitmap) {
+	return bitmap->row_size;
+}
+
+GBitmapDataRowInfo
+gbitmap_get_data_row_info(const GBitmap *bitmap, uint16_t y) {
+	GBitmapDataRowInfo result;
+
+	if (bitmap->format == GBitmapFormat8BitCircular) {
+		result.data = bitmap->data + bitmap->offset[y]
+		    - bitmap->min_x[y];
+		result.min_x = bitmap->min_x[y];
+		result.max_x = bitmap->max_x[y];
+	} else {
+		result.data = bitmap->data + (size_t)bitmap->row_size * y;
+		result.min_x = 0;
+		result.max_x = bitmap->size.w - 1;
+	}
+
+	return result;
+}
+
+/*
+ * The screen frame buffer. On chalk, rows are packed around a circle
+ * whose total size matches the 25868 bytes of the real display.
+ */
+
+static GBitmap *screen;
+
+static void
+screen_init(void) {
+#if defined(PBL_PLATFORM_APLITE)
+	screen = bitmap_alloc(GSize(SHIM_SCREEN_W, SHIM_SCREEN_H),
+	    GBitmapFormat1Bit);
+#elif defined(PBL_PLATFORM_BASALT)
+	screen = bitmap_alloc(GSize(SHIM_SCREEN_W, SHIM_SCREEN_H),
+	    GBitmapFormat8Bit);
+#else
+	size_t total = 0;
+	int y, half;
+
+	screen = bitmap_alloc(GSize(SHIM_SCREEN_W, SHIM_SCREEN_H),
+	    GBitmapFormat8BitCircular);
+	screen->min_x = calloc(SHIM_SCREEN_H, sizeof *screen->min_x);
+	screen->max_x = calloc(SHIM_SCREEN_H, sizeof *screen->max_x);
+	screen->offset = calloc(SHIM_SCREEN_H, sizeof *screen->offset);
+	for (y = 0; y < SHIM_SCREEN_H; y += 1) {
+		double d = fabs(y + 0.5 - SHIM_SCREEN_H / 2.0);
+		half = (int)(sqrt(90.0 * 90.0 - d * d) + 1.78);
+		if (half > SHIM_SCREEN_W / 2) half = SHIM_SCREEN_W / 2;
+		if (y == 0 || y == SHIM_SCREEN_H - 1) half += 1;
+		screen->min_x[y] = SHIM_SCREEN_W / 2 - half;
+		screen->max_x[y] = SHIM_SCREEN_W / 2 + half - 1;
+		screen->offset[y] = total;
+		total += 2 * half;
+	}
+	screen->data_size = total;
+#endif
+	screen->data = calloc(1, screen->data_size);
+}
+
+size_t
+shim_frame_buffer_size(void) {
+	return screen->data_size;
+}
+
+const uint8_t *
+shim_frame_buffer(void) {
+	return screen->data;
+}
+
+/************
+ * GRAPHICS *
+ ************/
+
+struct GContext {
+	GRect clip;
+	GPoint offset;
+	GColor stroke_color;
+	GColor fill_color;
+	GColor text_color;
+	uint8_t stroke_width;
+	GBitmap *captured;
+};
+
+static GContext context;
+static int capture_depth = 0;
+
+GFont
+fonts_get_system_font(const char *font_key) {
+	return font_key;
+}
+
+void graphics_context_set_stroke_color(GContext *ctx, GColor color)
+    { ctx->stroke_color = color; }
+void graphics_context_set_fill_color(GContext *ctx, GColor color)
+    { ctx->fill_color = color; }
+void graphics_context_set_text_color(GContext *ctx, GColor color)
+    { ctx->text_color = color; }
+void graphics_context_set_stroke_width(GContext *ctx, uint8_t width)
+    { ctx->stroke_width = width ? width : 1; }
+void graphics_context_set_antialiased(GContext *ctx, bool enable)
+    { (void)ctx; (void)enable; }
+
+/* plot in absolute screen coordinates, honoring clip and screen shape */
+static void
+plot(GContext *ctx, int x, int y, GColor color) {
+	GBitmapDataRowInfo row;
+
+	if (!color.a) return;
+	if (x < ctx->clip.origin.x || y < ctx->clip.origin.y
+	    || x >= ctx->clip.origin.x + ctx->clip.size.w
+	    || y >= ctx->clip.origin.y + ctx->clip.size.h)
+		return;
+	if (x < 0 || y < 0 || x >= screen->size.w || y >= screen->size.h)
+		return;
+
+	row = gbitmap_get_data_row_info(screen, y);
+	if (x < row.min_x || x > row.max_x) return;
+
+	shim_stats.pixels += 1;
+
+	if (screen->format == GBitmapFormat1Bit) {
+		if (color.r + color.g + color.b >= 6)
+			row.data[x / 8] |= 1 << (x % 8);
+		else
+			row.data[x / 8] &= ~(1 << (x % 8));
+	} else
+		row.data[x] = color.argb;
+}
+
+static void
+span(GContext *ctx, int x0, int x1, int y, GColor color) {
+	int x;
+	for (x = x0; x <= x1; x += 1) plot(ctx, x, y, color);
+}
+
+static void
+line(GContext *ctx, int x0, int y0, int x1, int y1, GColor color,
+    int width) {
+	int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+	int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+	int err = dx + dy, e2, i, j;
+	int lo = -(width - 1) / 2, hi = width / 2;
+
+	for (;;) {
+		if (width <= 1)
+			plot(ctx, x0, y0, color);
+		else for (i = lo; i <= hi; i += 1)
+			for (j = lo; j <= hi; j += 1)
+				if (i * i + j * j <= hi * hi + 1)
+					plot(ctx, x0 + i, y0 + j, color);
+		if (x0 == x1 && y0 == y1) break;
+		e2 = 2 * err;
+		if (e2 >= dy) { err += dy; x0 += sx; }
+		if (e2 <= dx) { err += dx; y0 += sy; }
+	}
+}
+
+void
+graphics_draw_pixel(GContext *ctx, GPoint point) {
+	shim_stats.pixel_calls += 1;
+	plot(ctx, point.x + ctx->offset.x, point.y + ctx->offset.y,
+	    ctx->stroke_color);
+}
+
+void
+graphics_draw_line(GContext *ctx, GPoint p0, GPoint p1) {
+	shim_stats.lines += 1;
+	line(ctx, p0.x + ctx->offset.x, p0.y + ctx->offset.y,
+	    p1.x + ctx->offset.x, p1.y + ctx->offset.y,
+	    ctx->stroke_color, ctx->stroke_width);
+}
+
+void
+graphics_draw_rect(GContext *ctx, GRect rect) {
+	int x0 = rect.origin.x + ctx->offset.x;
+	int y0 = rect.origin.y + ctx->offset.y;
+	int x1 = x0 + rect.size.w - 1;
+	int y1 = y0 + rect.size.h - 1;
+
+	shim_stats.rects += 1;
+	line(ctx, x0, y0, x1, y0, ctx->stroke_color, 1);
+	line(ctx, x0, y1, x1, y1, ctx->stroke_color, 1);
+	line(ctx, x0, y0, x0, y1, ctx->stroke_color, 1);
+	line(ctx, x1, y0, x1, y1, ctx->stroke_color, 1);
+}
+
+void
+graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius,
+    GCornerMask corner_mask) {
+	int x, y;
+
+	(void)corner_radius;
+	(void)corner_mask;
+	shim_stats.rects += 1;
+	for (y = 0; y < rect.size.h; y += 1)
+		for (x = 0; x < rect.size.w; x += 1)
+			plot(ctx, rect.origin.x + x + ctx->offset.x,
+			    rect.origin.y + y + ctx->offset.y,
+			    ctx->fill_color);
+}
+
+void
+graphics_draw_circle(GContext *ctx, GPoint p, uint16_t radius) {
+	int x = radius, y = 0, err = 1 - x;
+	int cx = p.x + ctx->offset.x, cy = p.y + ctx->offset.y;
+	GColor c = ctx->stroke_color;
+
+	shim_stats.circles += 1;
+	while (x >= y) {
+		plot(ctx, cx + x, cy + y, c); plot(ctx, cx - x, cy + y, c);
+		plot(ctx, cx + x, cy - y, c); plot(ctx, cx - x, cy - y, c);
+		plot(ctx, cx + y, cy + x, c); plot(ctx, cx - y, cy + x, c);
+		plot(ctx, cx + y, cy - x, c); plot(ctx, cx - y, cy - x, c);
+		y += 1;
+		if (err < 0) err += 2 * y + 1;
+		else { x -= 1; err += 2 * (y - x) + 1; }
+	}
+}
+
+void
+graphics_fill_circle(GContext *ctx, GPoint p, uint16_t radius) {
+	int x, y, r = radius;
+
+	shim_stats.circles += 1;
+	for (y = -r; y <= r; y += 1)
+		for (x = -r; x <= r; x += 1)
+			if (x * x + y * y <= r * r + r)
+				plot(ctx, p.x + x + ctx->offset.x,
+				    p.y + y + ctx->offset.y, ctx->fill_color);
+}
+
+/* text is only accounted as its bounding box, glyphs are not rendered */
+void
+graphics_draw_text(GContext *ctx, const char *text, GFont font,
+    GRect box, GTextOverflowMode overflow_mode, GTextAlignment alignment,
+    void *text_attributes) {
+	size_t area;
+
+	(void)ctx;
+	(void)font;
+	(void)overflow_mode;
+	(void)alignment;
+	(void)text_attributes;
+	shim_stats.texts += 1;
+	area = strlen(text) * 8 * (size_t)box.size.h / 2;
+	if (area > (size_t)box.size.w * box.size.h)
+		area = (size_t)box.size.w * box.size.h;
+	shim_stats.pixels += area;
+}
+
+void
+graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap,
+    GRect rect) {
+	GBitmapDataRowInfo row;
+	GColor color;
+	int x, y;
+
+	shim_stats.bitmaps += 1;
+	for (y = 0; y < rect.size.h && y < bitmap->size.h; y += 1) {
+		row = gbitmap_get_data_row_info(bitmap, y);
+		for (x = 0; x < rect.size.w && x < bitmap->size.w; x += 1) {
+			if (bitmap->format == GBitmapFormat1Bit)
+				color = (row.data[x / 8] & (1 << (x % 8)))
+				    ? GColorWhite : GColorBlack;
+			else
+				color.argb = row.data[x];
+			plot(ctx, rect.origin.x + x + ctx->offset.x,
+			    rect.origin.y + y + ctx->offset.y, color);
+		}
+	}
+}
+
+GBitmap *
+graphics_capture_frame_buffer(GContext *ctx) {
+	if (ctx->captured) return 0;
+	shim_stats.captures += 1;
+	ctx->captured = screen;
+	capture_depth += 1;
+	return screen;
+}
+
+bool
+graphics_release_frame_buffer(GContext *ctx, GBitmap *buffer) {
+	if (!ctx->captured || buffer != ctx->captured) return false;
+	ctx->captured = 0;
+	capture_depth -= 1;
+	return true;
+}
+
+void *
+shim_memcpy(void *dest, const void *src, size_t n) {
+	if (capture_depth > 0) shim_stats.bytes_copied += n;
+	return memcpy(dest, src, n);
+}
+
+void *
+shim_memset(void *dest, int c, size_t n) {
+	if (capture_depth > 0) shim_stats.bytes_copied += n;
+	return memset(dest, c, n);
+}
+
+/*********
+ * GPATH *
+ *********/
+
+GPath *
+gpath_create(const GPathInfo *init) {
+	GPath *result = calloc(1, sizeof *result);
+	result->num_points = init->num_points;
+	result->points = init->points;
+	return result;
+}
+
+void
+gpath_destroy(GPath *path) {
+	free(path);
+}
+
+void
+gpath_rotate_to(GPath *path, int32_t angle) {
+	path->rotation = angle;
+}
+
+void
+gpath_move_to(GPath *path, GPoint point) {
+	path->offset = point;
+}
+
+static void
+gpath_transform(GContext *ctx, const GPath *path, uint32_t i, int *x, int *y) {
+	int32_t s = sin_lookup(path->rotation);
+	int32_t c = cos_lookup(path->rotation);
+	int32_t px = path->points[i].x, py = path->points[i].y;
+
+	*x = (px * c - py * s) / TRIG_MAX_RATIO
+	    + path->offset.x + ctx->offset.x;
+	*y = (px * s + py * c) / TRIG_MAX_RATIO
+	    + path->offset.y + ctx->offset.y;
+}
+
+void
+gpath_draw_filled(GContext *ctx, GPath *path) {
+	int xs[16], ys[16], x, y, i, j, n = path->num_points;
+	int ymin = 9999, ymax = -9999;
+
+	shim_stats.path_fills += 1;
+	if (n > 16) n = 16;
+	for (i = 0; i < n; i += 1) {
+		gpath_transform(ctx, path, i, &xs[i], &ys[i]);
+		if (ys[i] < ymin) ymin = ys[i];
+		if (ys[i] > ymax) ymax = ys[i];
+	}
+
+	for (y = ymin; y <= ymax; y += 1) {
+		int cuts[16], ncuts = 0, a, b;
+		for (i = 0, j = n - 1; i < n; j = i++) {
+			if ((ys[i] <= y) == (ys[j] <= y)) continue;
+			cuts[ncuts++] = xs[i] + (y - ys[i])
+			    * (xs[j] - xs[i]) / (ys[j] - ys[i]);
+		}
+		for (a = 1; a < ncuts; a += 1)
+			for (b = a; b > 0 && cuts[b - 1] > cuts[b]; b -= 1) {
+				x = cuts[b]; cuts[b] = cuts[b - 1];
+				cuts[b - 1] = x;
+			}
+		for (a = 0; a + 1 < ncuts; a += 2)
+			span(ctx, cuts[a], cuts[a + 1], y, ctx->fill_color);
+	}
+}
+
+static void
+gpath_lines(GContext *ctx, GPath *path, bool closed) {
+	int x0, y0, x1, y1;
+	uint32_t i;
+
+	for (i = 0; i + (closed ? 0 : 1) < path->num_points; i += 1) {
+		gpath_transform(ctx, path, i, &x0, &y0);
+		gpath_transform(ctx, path, (i + 1) % path->num_points,
+		    &x1, &y1);
+		line(ctx, x0, y0, x1, y1, ctx->stroke_color,
+		    ctx->stroke_width);
+	}
+}
+
+void
+gpath_draw_outline(GContext *ctx, GPath *path) {
+	shim_stats.path_outlines += 1;
+	gpath_lines(ctx, path, true);
+}
+
+void
+gpath_draw_outline_open(GContext *ctx, GPath *path) {
+	shim_stats.path_outlines += 1;
+	gpath_lines(ctx, path, false);
+}
+
+/**********
+ * LAYERS *
+ **********/
+
+struct Layer {
+	GRect frame;
+	GRect bounds;
+	bool hidden;
+	LayerUpdateProc update_proc;
+	Layer *parent;
+	Layer *first_child;
+	Layer *next_sibling;
+	void *data;
+};
+
+struct TextLayer {
+	Layer layer;
+	const char *text;
+	GFont font;
+	GColor text_color;
+	GColor background_color;
+	GTextAlignment alignment;
+};
+
+struct Window {
+	Layer root;
+	GColor background_color;
+	WindowHandlers handlers;
+	bool loaded;
+};
+
+static Window *top_window;
+static bool screen_dirty = false;
+
+Layer *
+layer_create(GRect frame) {
+	Layer *result = calloc(1, sizeof *result);
+	result->frame = frame;
+	result->bounds = GRect(0, 0, frame.size.w, frame.size.h);
+	return result;
+}
+
+Layer *
+layer_create_with_data(GRect frame, size_t data_size) {
+	Layer *result = layer_create(frame);
+	result->data = calloc(1, data_size);
+	return result;
+}
+
+void
+layer_destroy(Layer *layer) {
+	if (!layer) return;
+	layer_remove_from_parent(layer);
+	free(layer->data);
+	free(layer);
+}
+
+void *
+layer_get_data(const Layer *layer) {
+	return layer->data;
+}
+
+void
+layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc) {
+	layer->update_proc = update_proc;
+}
+
+void
+layer_mark_dirty(Layer *layer) {
+	(void)layer;
+	screen_dirty = true;
+}
+
+void
+layer_set_hidden(Layer *layer, bool hidden) {
+	if (layer->hidden == hidden) return;
+	layer->hidden = hidden;
+	screen_dirty = true;
+}
+
+bool
+layer_get_hidden(const Layer *layer) {
+	return layer->hidden;
+}
+
+GRect
+layer_get_bounds(const Layer *layer) {
+	return layer->bounds;
+}
+
+GRect
+layer_get_frame(const Layer *layer) {
+	return layer->frame;
+}
+
+void
+layer_set_frame(Layer *layer, GRect frame) {
+	if (grect_equal(&layer->frame, &frame)) return;
+	layer->frame = frame;
+	layer->bounds.size = frame.size;
+	screen_dirty = true;
+}
+
+void
+layer_set_bounds(Layer *layer, GRect bounds) {
+	layer->bounds = bounds;
+	screen_dirty = true;
+}
+
+void
+layer_add_child(Layer *parent, Layer *child) {
+	Layer **slot = &parent->first_child;
+	while (*slot) slot = &(*slot)->next_sibling;
+	*slot = child;
+	child->parent = parent;
+	child->next_sibling = 0;
+	screen_dirty = true;
+}
+
+void
+layer_remove_from_parent(Layer *child) {
+	Layer **slot;
+
+	if (!child->parent) return;
+	slot = &child->parent->first_child;
+	while (*slot && *slot != child) slot = &(*slot)->next_sibling;
+	if (*slot) *slot = child->next_sibling;
+	child->parent = 0;
+	child->next_sibling = 0;
+	screen_dirty = true;
+}
+
+static void
+layer_insert(Layer *layer, Layer *sibling, bool above) {
+	Layer **slot;
+
+	layer_remove_from_parent(layer);
+	slot = &sibling->parent->first_child;
+	while (*slot != sibling) slot = &(*slot)->next_sibling;
+	if (above) slot = &sibling->next_sibling;
+	layer->next_sibling = *slot;
+	*slot = layer;
+	layer->parent = sibling->parent;
+	screen_dirty = true;
+}
+
+void
+layer_insert_below_sibling(Layer *layer, Layer *below_sibling) {
+	layer_insert(layer, below_sibling, false);
+}
+
+void
+layer_insert_above_sibling(Layer *layer, Layer *above_sibling) {
+	layer_insert(layer, above_sibling, true);
+}
+
+static void
+text_layer_draw(Layer *layer, GContext *ctx) {
+	TextLayer *text_layer = (TextLayer *)layer;
+
+	if (text_layer->background_color.a) {
+		graphics_context_set_fill_color(ctx,
+		    text_layer->background_color);
+		graphics_fill_rect(ctx, layer->bounds, 0, GCornerNone);
+	}
+	if (!text_layer->text || !text_layer->text[0]) return;
+	graphics_context_set_text_color(ctx, text_layer->text_color);
+	graphics_draw_text(ctx, text_layer->text, text_layer->font,
+	    layer->bounds, GTextOverflowModeWordWrap, text_layer->alignment,
+	    0);
+}
+
+TextLayer *
+text_layer_create(GRect frame) {
+	TextLayer *result = calloc(1, sizeof *result);
+	result->layer.frame = frame;
+	result->layer.bounds = GRect(0, 0, frame.size.w, frame.size.h);
+	result->layer.update_proc = &text_layer_draw;
+	result->text_color = GColorBlack;
+	result->background_color = GColorWhite;
+	return result;
+}
+
+void
+text_layer_destroy(TextLayer *text_layer) {
+	if (!text_layer) return;
+	layer_remove_from_parent(&text_layer->layer);
+	free(text_layer);
+}
+
+Layer *
+text_layer_get_layer(TextLayer *text_layer) {
+	return &text_layer->layer;
+}
+
+void
+text_layer_set_text(TextLayer *text_layer, const char *text) {
+	text_layer->text = text;
+	screen_dirty = true;
+}
+
+const char *
+text_layer_get_text(TextLayer *text_layer) {
+	return text_layer->text;
+}
+
+void
+text_layer_set_text_color(TextLayer *text_layer, GColor color) {
+	text_layer->text_color = color;
+	screen_dirty = true;
+}
+
+void
+text_layer_set_background_color(TextLayer *text_layer, GColor color) {
+	text_layer->background_color = color;
+	screen_dirty = true;
+}
+
+void
+text_layer_set_text_alignment(TextLayer *text_layer,
+    GTextAlignment alignment) {
+	text_layer->alignment = alignment;
+	screen_dirty = true;
+}
+
+void
+text_layer_set_font(TextLayer *text_layer, GFont font) {
+	text_layer->font = font;
+	screen_dirty = true;
+}
+
+Window *
+window_create(void) {
+	Window *result = calloc(1, sizeof *result);
+	result->root.frame = result->root.bounds
+	    = GRect(0, 0, SHIM_SCREEN_W, SHIM_SCREEN_H);
+	result->background_color = GColorWhite;
+	return result;
+}
+
+void
+window_destroy(Window *window) {
+	if (window == top_window) {
+		if (window->handlers.unload) window->handlers.unload(window);
+		top_window = 0;
+	}
+	free(window);
+}
+
+void
+window_set_window_handlers(Window *window, WindowHandlers handlers) {
+	window->handlers = handlers;
+}
+
+Layer *
+window_get_root_layer(const Window *window) {
+	return (Layer *)&window->root;
+}
+
+void
+window_set_background_color(Window *window, GColor color) {
+	window->background_color = color;
+	screen_dirty = true;
+}
+
+void
+window_stack_push(Window *window, bool animated) {
+	(void)animated;
+	top_window = window;
+	if (!window->loaded && window->handlers.load) {
+		window->loaded = true;
+		window->handlers.load(window);
+	}
+	if (window->handlers.appear) window->handlers.appear(window);
+	screen_dirty = true;
+}
+
+/*
+ * Like the firmware, a dirty window is rendered as a whole: the root
+ * layer is filled with the background color unless it is clear, then
+ * every visible layer is drawn clipped to its frame.
+ */
+
+static void
+render_layer(Layer *layer, GPoint origin, GRect clip) {
+	Layer *child;
+	GRect frame;
+	int x0, y0, x1, y1;
+
+	if (layer->hidden) return;
+
+	origin.x += layer->frame.origin.x;
+	origin.y += layer->frame.origin.y;
+	x0 = origin.x > clip.origin.x ? origin.x : clip.origin.x;
+	y0 = origin.y > clip.origin.y ? origin.y : clip.origin.y;
+	x1 = origin.x + layer->frame.size.w;
+	y1 = origin.y + layer->frame.size.h;
+	if (x1 > clip.origin.x + clip.size.w) x1 = clip.origin.x + clip.size.w;
+	if (y1 > clip.origin.y + clip.size.h) y1 = clip.origin.y + clip.size.h;
+	if (x1 <= x0 || y1 <= y0) return;
+	frame = GRect(x0, y0, x1 - x0, y1 - y0);
+
+	if (layer->update_proc) {
+		context.clip = frame;
+		context.offset.x = origin.x + layer->bounds.origin.x;
+		context.offset.y = origin.y + layer->bounds.origin.y;
+		context.stroke_color = GColorBlack;
+		context.fill_color = GColorBlack;
+		context.stroke_width = 1;
+		shim_stats.layer_updates += 1;
+		layer->update_proc(layer, &context);
+	}
+
+	for (child = layer->first_child; child; child = child->next_sibling)
+		render_layer(child, origin, frame);
+}
+
+void
+shim_render(void) {
+	GRect full = GRect(0, 0, SHIM_SCREEN_W, SHIM_SCREEN_H);
+
+	if (!screen) screen_init();
+	if (!top_window || !screen_dirty) return;
+	screen_dirty = false;
+	shim_stats.frames += 1;
+
+	if (top_window->background_color.a) {
+		context.clip = full;
+		context.offset = GPoint(0, 0);
+		context.fill_color = top_window->background_color;
+		graphics_fill_rect(&context, full, 0, GCornerNone);
+	}
+
+	render_layer(&top_window->root, GPoint(0, 0), full);
+}
+
+/***********
+ * STORAGE *
+ ***********/
+
+static struct {
+	bool exists;
+	size_t size;
+	uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} storage[256];
+
+bool
+persist_exists(uint32_t key) {
+	return key < 256 && storage[key].exists;
+}
+
+int
+persist_get_size(uint32_t key) {
+	if (!persist_exists(key)) return E_DOES_NOT_EXIST;
+	return storage[key].size;
+}
+
+int
+persist_read_data(uint32_t key, void *buffer, size_t buffer_size) {
+	if (!persist_exists(key)) return E_DOES_NOT_EXIST;
+	if (buffer_size > storage[key].size) buffer_size = storage[key].size;
+	memcpy(buffer, storage[key].data, buffer_size);
+	return buffer_size;
+}
+
+int
+persist_write_data(uint32_t key, const void *data, size_t size) {
+	if (key >= 256) return E_INVALID_ARGUMENT;
+	if (size > PERSIST_DATA_MAX_LENGTH) size = PERSIST_DATA_MAX_LENGTH;
+	shim_stats.persist_writes += 1;
+	shim_stats.persist_bytes += size;
+	storage[key].exists = true;
+	storage[key].size = size;
+	memcpy(storage[key].data, data, size);
+	return size;
+}
+
+int32_t
+persist_read_int(uint32_t key) {
+	int32_t result = 0;
+	persist_read_data(key, &result, sizeof result);
+	return result;
+}
+
+StatusCode
+persist_write_int(uint32_t key, int32_t value) {
+	int i = persist_write_data(key, &value, sizeof value);
+	return i < 0 ? (StatusCode)i : S_SUCCESS;
+}
+
+StatusCode
+persist_delete(uint32_t key) {
+	if (!persist_exists(key)) return E_DOES_NOT_EXIST;
+	storage[key].exists = false;
+	return S_TRUE;
+}
+
+/************
+ * SERVICES *
+ ************/
+
+static TickHandler tick_handler_cb;
+static TimeUnits tick_units;
+static struct tm last_tick;
+static BatteryStateHandler battery_handler_cb;
+static BatteryChargeState battery_state = { 100, false, false };
+static ConnectionHandler connection_handler_cb;
+static bool connected = true;
+static AppMessageInboxReceived inbox_handler_cb;
+static AccelTapHandler tap_handler_cb;
+static AccelData accel_state = { 0, 0, -1000, false, 0 };
+
+void
+tick_timer_service_subscribe(TimeUnits units, TickHandler handler) {
+	tick_units = units;
+	tick_handler_cb = handler;
+}
+
+void
+tick_timer_service_unsubscribe(void) {
+	tick_handler_cb = 0;
+}
+
+void
+accel_tap_service_subscribe(AccelTapHandler handler) {
+	tap_handler_cb = handler;
+}
+
+void
+accel_tap_service_unsubscribe(void) {
+	tap_handler_cb = 0;
+}
+
+int
+accel_service_peek(AccelData *data) {
+	*data = accel_state;
+	return 0;
+}
+
+void
+battery_state_service_subscribe(BatteryStateHandler handler) {
+	battery_handler_cb = handler;
+}
+
+void
+battery_state_service_unsubscribe(void) {
+	battery_handler_cb = 0;
+}
+
+BatteryChargeState
+battery_state_service_peek(void) {
+	return battery_state;
+}
+
+void
+connection_service_subscribe(ConnectionHandlers handlers) {
+	connection_handler_cb = handlers.pebble_app_connection_handler;
+}
+
+void
+connection_service_unsubscribe(void) {
+	connection_handler_cb = 0;
+}
+
+bool
+connection_service_peek_pebble_app_connection(void) {
+	return connected;
+}
+
+void
+vibes_long_pulse(void) {
+	shim_stats.vibrations += 1;
+}
+
+void
+vibes_short_pulse(void) {
+	shim_stats.vibrations += 1;
+}
+
+uint16_t
+time_ms(time_t *tloc, uint16_t *out_ms) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	if (tloc) *tloc = ts.tv_sec;
+	if (out_ms) *out_ms = ts.tv_nsec / 1000000;
+	return ts.tv_nsec / 1000000;
+}
+
+/* timers fire from shim_advance, on a virtual millisecond clock */
+struct AppTimer {
+	bool active;
+	uint64_t due;
+	AppTimerCallback callback;
+	void *data;
+};
+
+static struct AppTimer timers[8];
+static uint64_t timer_clock;
+
+AppTimer *
+app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+    void *callback_data) {
+	size_t i;
+
+	for (i = 0; i < sizeof timers / sizeof *timers; i += 1) {
+		if (timers[i].active) continue;
+		timers[i].active = true;
+		timers[i].due = timer_clock + timeout_ms;
+		timers[i].callback = callback;
+		timers[i].data = callback_data;
+		return &timers[i];
+	}
+
+	return 0;
+}
+
+bool
+app_timer_reschedule(AppTimer *timer, uint32_t new_timeout_ms) {
+	if (!timer || !timer->active) return false;
+	timer->due = timer_clock + new_timeout_ms;
+	return true;
+}
+
+void
+app_timer_cancel(AppTimer *timer) {
+	if (timer) timer->active = false;
+}
+
+void
+app_event_loop(void) {
+	shim_render();
+}
+
+void
+shim_tick(struct tm *tick_time) {
+	TimeUnits changed = 0;
+
+	if (tick_time->tm_sec != last_tick.tm_sec) changed |= SECOND_UNIT;
+	if (tick_time->tm_min != last_tick.tm_min) changed |= MINUTE_UNIT;
+	if (tick_time->tm_hour != last_tick.tm_hour) changed |= HOUR_UNIT;
+	if (tick_time->tm_mday != last_tick.tm_mday) changed |= DAY_UNIT;
+	if (tick_time->tm_mon != last_tick.tm_mon) changed |= MONTH_UNIT;
+	if (tick_time->tm_year != last_tick.tm_year) changed |= YEAR_UNIT;
+	last_tick = *tick_time;
+
+	if (tick_handler_cb && (changed & tick_units)) {
+		shim_stats.wakeups += 1;
+		tick_handler_cb(tick_time, changed);
+	}
+	shim_render();
+}
+
+void
+shim_set_battery(uint8_t percent) {
+	battery_state.charge_percent = percent;
+	if (battery_handler_cb) {
+		shim_stats.wakeups += 1;
+		battery_handler_cb(battery_state);
+	}
+	shim_render();
+}
+
+void
+shim_set_connection(bool state) {
+	connected = state;
+	if (connection_handler_cb) {
+		shim_stats.wakeups += 1;
+		connection_handler_cb(state);
+	}
+	shim_render();
+}
+
+void
+shim_set_accel(int16_t x, int16_t y, int16_t z) {
+	accel_state.x = x;
+	accel_state.y = y;
+	accel_state.z = z;
+}
+
+void
+shim_advance(uint32_t elapsed_ms) {
+	struct AppTimer *next;
+	size_t i;
+
+	timer_clock += elapsed_ms;
+
+	for (;;) {
+		next = 0;
+		for (i = 0; i < sizeof timers / sizeof *timers; i += 1)
+			if (timers[i].active && timers[i].due <= timer_clock
+			    && (!next || timers[i].due < next->due))
+				next = &timers[i];
+		if (!next) break;
+
+		next->active = false;
+		shim_stats.wakeups += 1;
+		next->callback(next->data);
+	}
+
+	shim_render();
+}
+
+void
+shim_tap(void) {
+	if (tap_handler_cb) {
+		shim_stats.wakeups += 1;
+		tap_handler_cb(ACCEL_AXIS_Z, 1);
+	}
+	shim_render();
+}
+
+/**************
+ * APPMESSAGE *
+ **************/
+
+Tuple *
+dict_read_first(DictionaryIterator *iter) {
+	iter->cursor = (Tuple *)iter->begin;
+	if ((uint8_t *)iter->cursor >= iter->end) return 0;
+	return iter->cursor;
+}
+
+Tuple *
+dict_read_next(DictionaryIterator *iter) {
+	uint8_t *next = (uint8_t *)iter->cursor + sizeof(Tuple)
+	    + iter->cursor->length;
+	if (next >= iter->end) return 0;
+	iter->cursor = (Tuple *)next;
+	return iter->cursor;
+}
+
+Tuple *
+dict_find(const DictionaryIterator *iter, const uint32_t key) {
+	DictionaryIterator copy = *iter;
+	Tuple *tuple;
+
+	for (tuple = dict_read_first(&copy); tuple;
+	    tuple = dict_read_next(&copy))
+		if (tuple->key == key) return tuple;
+	return 0;
+}
+
+/* one count byte, then a 7-byte header before each tuple value */
+uint32_t
+dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+	uint32_t result = 1;
+	va_list ap;
+	uint8_t i;
+
+	va_start(ap, tuple_count);
+	for (i = 0; i < tuple_count; i += 1)
+		result += sizeof(Tuple) + va_arg(ap, uint32_t);
+	va_end(ap);
+
+	return result;
+}
+
+static uint32_t inbox_size = 0;
+static uint32_t outbox_size = 0;
+static uint8_t outbox_buffer[1024];
+static DictionaryIterator outbox;
+static bool outbox_open = false;
+
+uint32_t
+shim_inbox_size(void) {
+	return inbox_size;
+}
+
+uint32_t
+shim_outbox_size(void) {
+	return outbox_size;
+}
+
+/* last message sent by the face */
+DictionaryIterator *
+shim_outbox(void) {
+	return &outbox;
+}
+
+AppMessageInboxReceived
+app_message_register_inbox_received(AppMessageInboxReceived callback) {
+	AppMessageInboxReceived previous = inbox_handler_cb;
+	inbox_handler_cb = callback;
+	return previous;
+}
+
+AppMessageResult
+app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+	inbox_size = size_inbound;
+	outbox_size = size_outbound;
+	if (outbox_size > sizeof outbox_buffer)
+		outbox_size = sizeof outbox_buffer;
+	return APP_MSG_OK;
+}
+
+AppMessageResult
+app_message_outbox_begin(DictionaryIterator **iterator) {
+	if (outbox_size < 1) return APP_MSG_OUT_OF_MEMORY;
+	if (outbox_open) return APP_MSG_BUSY;
+	outbox.begin = outbox.end = outbox_buffer;
+	outbox.cursor = 0;
+	outbox_open = true;
+	*iterator = &outbox;
+	return APP_MSG_OK;
+}
+
+/* delivered at once, the count byte included in the size */
+AppMessageResult
+app_message_outbox_send(void) {
+	if (!outbox_open) return APP_MSG_BUSY;
+	outbox_open = false;
+	shim_stats.outbox_messages += 1;
+	shim_stats.outbox_bytes += 1 + (outbox.end - outbox.begin);
+	return APP_MSG_OK;
+}
+
+void
+shim_dict_init(DictionaryIterator *iter, uint8_t *buffer, size_t size) {
+	(void)size;
+	iter->begin = iter->end = buffer;
+	iter->cursor = 0;
+}
+
+static void
+dict_add(DictionaryIterator *iter, uint32_t key, TupleType type,
+    const void *value, uint16_t length) {
+	Tuple *tuple = (Tuple *)iter->end;
+
+	tuple->key = key;
+	tuple->type = type;
+	tuple->length = length;
+	memcpy(tuple->value->data, value, length);
+	iter->end += sizeof(Tuple) + length;
+}
+
+void
+shim_dict_add_uint(DictionaryIterator *iter, uint32_t key, uint32_t value) {
+	dict_add(iter, key, TUPLE_UINT, &value, sizeof value);
+}
+
+void
+shim_dict_add_cstring(DictionaryIterator *iter, uint32_t key,
+    const char *value) {
+	dict_add(iter, key, TUPLE_CSTRING, value, strlen(value) + 1);
+}
+
+void
+shim_dict_add_data(DictionaryIterator *iter, uint32_t key,
+    const uint8_t *data, uint16_t size) {
+	dict_add(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult
+dict_write_data(DictionaryIterator *iter, const uint32_t key,
+    const uint8_t *data, const uint16_t size) {
+	if (!iter || !data) return DICT_INVALID_ARGS;
+	if (iter == &outbox && 1 + (size_t)(iter->end - iter->begin)
+	    + sizeof(Tuple) + size > outbox_size)
+		return DICT_NOT_ENOUGH_STORAGE;
+	dict_add(iter, key, TUPLE_BYTE_ARRAY, data, size);
+	return DICT_OK;
+}
+
+/* messages larger than the opened inbox are dropped, as on the watch */
+void
+shim_inbox(DictionaryIterator *iter) {
+	size_t size = 1 + (iter->end - iter->begin);
+
+	if (size > inbox_size) {
+		fprintf(stderr, "message of %zu bytes dropped, "
+		    "inbox is %lu bytes\n", size, (unsigned long)inbox_size);
+		return;
+	}
+
+	if (inbox_handler_cb) {
+		shim_stats.wakeups += 1;
+		inbox_handler_cb(iter, 0);
+	}
+	shim_render();
+}
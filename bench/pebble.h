@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2015, Natacha Porté
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Host-side stand-in for the subset of the Pebble SDK 3 API used by the
+ * face. Drawing calls are rasterized (roughly) into a real frame buffer
+ * and counted, so that the cost of each event can be measured on Linux.
+ * Select the platform with -DPBL_PLATFORM_APLITE, _BASALT or _CHALK.
+ */
+
+#ifndef SHIM_PEBBLE_H
+#define SHIM_PEBBLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*************
+ * PLATFORMS *
+ *************/
+
+#define PBL_SDK_3
+
+#if defined(PBL_PLATFORM_APLITE)
+#define PBL_BW
+#define PBL_RECT
+#define SHIM_SCREEN_W 144
+#define SHIM_SCREEN_H 168
+#elif defined(PBL_PLATFORM_BASALT)
+#define PBL_COLOR
+#define PBL_RECT
+#define SHIM_SCREEN_W 144
+#define SHIM_SCREEN_H 168
+#elif defined(PBL_PLATFORM_CHALK)
+#define PBL_COLOR
+#define PBL_ROUND
+#define SHIM_SCREEN_W 180
+#define SHIM_SCREEN_H 180
+#else
+#error "define one of PBL_PLATFORM_APLITE, _BASALT or _CHALK"
+#endif
+
+#ifdef PBL_RECT
+#define PBL_IF_RECT_ELSE(if_true, if_false) (if_true)
+#define PBL_IF_ROUND_ELSE(if_true, if_false) (if_false)
+#else
+#define PBL_IF_RECT_ELSE(if_true, if_false) (if_false)
+#define PBL_IF_ROUND_ELSE(if_true, if_false) (if_true)
+#endif
+
+#ifdef PBL_COLOR
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_true)
+#define PBL_IF_BW_ELSE(if_true, if_false) (if_false)
+#else
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_false)
+#define PBL_IF_BW_ELSE(if_true, if_false) (if_true)
+#endif
+
+/***********
+ * LOGGING *
+ ***********/
+
+typedef enum {
+	APP_LOG_LEVEL_ERROR = 1,
+	APP_LOG_LEVEL_WARNING = 50,
+	APP_LOG_LEVEL_INFO = 100,
+	APP_LOG_LEVEL_DEBUG = 200,
+} AppLogLevel;
+
+void app_log(uint8_t level, const char *file, int line, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+#define APP_LOG(level, ...) app_log((level), __FILE__, __LINE__, __VA_ARGS__)
+
+/********************
+ * COLORS AND SHAPES *
+ ********************/
+
+typedef union GColor8 {
+	uint8_t argb;
+	struct {
+		uint8_t b:2;
+		uint8_t g:2;
+		uint8_t r:2;
+		uint8_t a:2;
+	};
+} GColor8;
+typedef GColor8 GColor;
+
+#define GColorClear     ((GColor8){ .argb = 0x00 })
+#define GColorBlack     ((GColor8){ .argb = 0xC0 })
+#define GColorDarkGray  ((GColor8){ .argb = 0xD5 })
+#define GColorLightGray ((GColor8){ .argb = 0xEA })
+#define GColorWhite     ((GColor8){ .argb = 0xFF })
+#define GColorFromHEX(v) ((GColor8){ .argb = (uint8_t)(0xC0 \
+    | ((((v) >> 22) & 3) << 4) | ((((v) >> 14) & 3) << 2) \
+    | (((v) >> 6) & 3)) })
+#define gcolor_equal(a, b) ((a).argb == (b).argb)
+
+typedef struct GPoint { int16_t x, y; } GPoint;
+typedef struct GSize { int16_t w, h; } GSize;
+typedef struct GRect { GPoint origin; GSize size; } GRect;
+typedef struct GEdgeInsets { int16_t top, right, bottom, left; } GEdgeInsets;
+
+#define GPoint(x, y) ((GPoint){ (x), (y) })
+#define GPointZero GPoint(0, 0)
+#define GSize(w, h) ((GSize){ (w), (h) })
+#define GRect(x, y, w, h) ((GRect){ { (x), (y) }, { (w), (h) } })
+#define GRectZero GRect(0, 0, 0, 0)
+#define GEdgeInsets(a) ((GEdgeInsets){ (a), (a), (a), (a) })
+
+GRect grect_inset(GRect rect, GEdgeInsets insets);
+GPoint grect_center_point(const GRect *rect);
+bool grect_equal(const GRect *a, const GRect *b);
+bool grect_contains_point(const GRect *rect, const GPoint *point);
+bool gpoint_equal(const GPoint *a, const GPoint *b);
+
+typedef enum {
+	GCornerNone = 0,
+} GCornerMask;
+
+typedef enum {
+	GTextAlignmentLeft,
+	GTextAlignmentCenter,
+	GTextAlignmentRight,
+} GTextAlignment;
+
+typedef enum {
+	GTextOverflowModeWordWrap,
+	GTextOverflowModeTrailingEllipsis,
+	GTextOverflowModeFill,
+} GTextOverflowMode;
+
+/********
+ * MATH *
+ ********/
+
+#define TRIG_MAX_RATIO 0xffff
+#define TRIG_MAX_ANGLE 0x10000
+#define DEG_TO_TRIGANGLE(deg) ((deg) * TRIG_MAX_ANGLE / 360)
+
+int32_t sin_lookup(int32_t angle);
+int32_t cos_lookup(int32_t angle);
+
+/***********
+ * BITMAPS *
+ ***********/
+
+typedef enum {
+	GBitmapFormat1Bit = 0,
+	GBitmapFormat8Bit,
+	GBitmapFormat1BitPalette,
+	GBitmapFormat2BitPalette,
+	GBitmapFormat4BitPalette,
+	GBitmapFormat8BitCircular,
+} GBitmapFormat;
+
+typedef struct {
+	uint8_t *data;
+	int16_t min_x;
+	int16_t max_x;
+} GBitmapDataRowInfo;
+
+typedef struct GBitmap GBitmap;
+
+GBitmap *gbitmap_create_blank(GSize size, GBitmapFormat format);
+void gbitmap_destroy(GBitmap *bitmap);
+GRect gbitmap_get_bounds(const GBitmap *bitmap);
+GBitmapFormat gbitmap_get_format(const GBitmap *bitmap);
+uint8_t *gbitmap_get_data(const GBitmap *bitmap);
+uint16_t gbitmap_get_bytes_per_row(const GBitmap *bitmap);
+GBitmapDataRowInfo gbitmap_get_data_row_info(const GBitmap *bitmap,
+    uint16_t y);
+
+/************
+ * GRAPHICS *
+ ************/
+
+typedef struct GContext GContext;
+typedef const char *GFont;
+
+#define FONT_KEY_GOTHIC_14 "RESOURCE_ID_GOTHIC_14"
+#define FONT_KEY_GOTHIC_18 "RESOURCE_ID_GOTHIC_18"
+#define FONT_KEY_GOTHIC_24 "RESOURCE_ID_GOTHIC_24"
+#define FONT_KEY_GOTHIC_28 "RESOURCE_ID_GOTHIC_28"
+
+GFont fonts_get_system_font(const char *font_key);
+
+void graphics_context_set_stroke_color(GContext *ctx, GColor color);
+void graphics_context_set_fill_color(GContext *ctx, GColor color);
+void graphics_context_set_text_color(GContext *ctx, GColor color);
+void graphics_context_set_stroke_width(GContext *ctx, uint8_t width);
+void graphics_context_set_antialiased(GContext *ctx, bool enable);
+void graphics_draw_pixel(GContext *ctx, GPoint point);
+void graphics_draw_line(GContext *ctx, GPoint p0, GPoint p1);
+void graphics_draw_rect(GContext *ctx, GRect rect);
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius,
+    GCornerMask corner_mask);
+void graphics_draw_circle(GContext *ctx, GPoint p, uint16_t radius);
+void graphics_fill_circle(GContext *ctx, GPoint p, uint16_t radius);
+void graphics_draw_text(GContext *ctx, const char *text, GFont font,
+    GRect box, GTextOverflowMode overflow_mode, GTextAlignment alignment,
+    void *text_attributes);
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap,
+    GRect rect);
+GBitmap *graphics_capture_frame_buffer(GContext *ctx);
+bool graphics_release_frame_buffer(GContext *ctx, GBitmap *buffer);
+
+typedef struct GPathInfo {
+	uint32_t num_points;
+	GPoint *points;
+} GPathInfo;
+
+typedef struct GPath {
+	uint32_t num_points;
+	GPoint *points;
+	int32_t rotation;
+	GPoint offset;
+} GPath;
+
+GPath *gpath_create(const GPathInfo *init);
+void gpath_destroy(GPath *path);
+void gpath_rotate_to(GPath *path, int32_t angle);
+void gpath_move_to(GPath *path, GPoint point);
+void gpath_draw_filled(GContext *ctx, GPath *path);
+void gpath_draw_outline(GContext *ctx, GPath *path);
+void gpath_draw_outline_open(GContext *ctx, GPath *path);
+
+/**********
+ * LAYERS *
+ **********/
+
+typedef struct Layer Layer;
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+
+Layer *layer_create(GRect frame);
+Layer *layer_create_with_data(GRect frame, size_t data_size);
+void layer_destroy(Layer *layer);
+void *layer_get_data(const Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc);
+void layer_mark_dirty(Layer *layer);
+void layer_set_hidden(Layer *layer, bool hidden);
+bool layer_get_hidden(const Layer *layer);
+GRect layer_get_bounds(const Layer *layer);
+GRect layer_get_frame(const Layer *layer);
+void layer_set_frame(Layer *layer, GRect frame);
+void layer_set_bounds(Layer *layer, GRect bounds);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_remove_from_parent(Layer *child);
+void layer_insert_below_sibling(Layer *layer, Layer *below_sibling);
+void layer_insert_above_sibling(Layer *layer, Layer *above_sibling);
+
+typedef struct TextLayer TextLayer;
+
+TextLayer *text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *text_layer);
+Layer *text_layer_get_layer(TextLayer *text_layer);
+void text_layer_set_text(TextLayer *text_layer, const char *text);
+const char *text_layer_get_text(TextLayer *text_layer);
+void text_layer_set_text_color(TextLayer *text_layer, GColor color);
+void text_layer_set_background_color(TextLayer *text_layer, GColor color);
+void text_layer_set_text_alignment(TextLayer *text_layer,
+    GTextAlignment alignment);
+void text_layer_set_font(TextLayer *text_layer, GFont font);
+
+typedef struct Window Window;
+typedef void (*WindowHandler)(Window *window);
+typedef struct WindowHandlers {
+	WindowHandler load;
+	WindowHandler appear;
+	WindowHandler disappear;
+	WindowHandler unload;
+} WindowHandlers;
+
+Window *window_create(void);
+void window_destroy(Window *window);
+void window_set_window_handlers(Window *window, WindowHandlers handlers);
+Layer *window_get_root_layer(const Window *window);
+void window_set_background_color(Window *window, GColor color);
+void window_stack_push(Window *window, bool animated);
+
+/***********
+ * STORAGE *
+ ***********/
+
+typedef enum {
+	S_SUCCESS = 0,
+	E_ERROR = -1,
+	E_UNKNOWN = -2,
+	E_INVALID_ARGUMENT = -3,
+	E_OUT_OF_MEMORY = -4,
+	E_OUT_OF_STORAGE = -5,
+	E_OUT_OF_RESOURCES = -6,
+	E_RANGE = -7,
+	E_DOES_NOT_EXIST = -8,
+	E_INVALID_OPERATION = -9,
+	E_BUSY = -10,
+	S_TRUE = 1,
+	S_FALSE = 0,
+	S_NO_MORE_ITEMS = 2,
+	S_NO_ACTION_REQUIRED = 3,
+} StatusCode;
+
+#define PERSIST_DATA_MAX_LENGTH 256
+
+bool persist_exists(uint32_t key);
+int persist_get_size(uint32_t key);
+int persist_read_data(uint32_t key, void *buffer, size_t buffer_size);
+int persist_write_data(uint32_t key, const void *data, size_t size);
+int32_t persist_read_int(uint32_t key);
+StatusCode persist_write_int(uint32_t key, int32_t value);
+StatusCode persist_delete(uint32_t key);
+
+/************
+ * SERVICES *
+ ************/
+
+typedef enum {
+	SECOND_UNIT = 1 << 0,
+	MINUTE_UNIT = 1 << 1,
+	HOUR_UNIT = 1 << 2,
+	DAY_UNIT = 1 << 3,
+	MONTH_UNIT = 1 << 4,
+	YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+
+typedef struct {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+	bool did_vibrate;
+	uint64_t timestamp;
+} AccelData;
+
+typedef enum {
+	ACCEL_AXIS_X = 0,
+	ACCEL_AXIS_Y = 1,
+	ACCEL_AXIS_Z = 2,
+} AccelAxisType;
+
+typedef void (*AccelTapHandler)(AccelAxisType axis, int32_t direction);
+void accel_tap_service_subscribe(AccelTapHandler handler);
+void accel_tap_service_unsubscribe(void);
+int accel_service_peek(AccelData *data);
+
+typedef struct {
+	uint8_t charge_percent;
+	bool is_charging;
+	bool is_plugged;
+} BatteryChargeState;
+
+typedef void (*BatteryStateHandler)(BatteryChargeState charge);
+void battery_state_service_subscribe(BatteryStateHandler handler);
+void battery_state_service_unsubscribe(void);
+BatteryChargeState battery_state_service_peek(void);
+
+typedef void (*ConnectionHandler)(bool connected);
+typedef struct ConnectionHandlers {
+	ConnectionHandler pebble_app_connection_handler;
+	ConnectionHandler pebblekit_connection_handler;
+} ConnectionHandlers;
+
+void connection_service_subscribe(ConnectionHandlers handlers);
+void connection_service_unsubscribe(void);
+bool connection_service_peek_pebble_app_connection(void);
+
+void vibes_long_pulse(void);
+void vibes_short_pulse(void);
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms);
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+    void *callback_data);
+bool app_timer_reschedule(AppTimer *timer, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer *timer);
+
+void app_event_loop(void);
+
+/**************
+ * APPMESSAGE *
+ **************/
+
+typedef enum {
+	TUPLE_BYTE_ARRAY = 0,
+	TUPLE_CSTRING = 1,
+	TUPLE_UINT = 2,
+	TUPLE_INT = 3,
+} TupleType;
+
+typedef union {
+	uint8_t data[0];
+	char cstring[0];
+	uint8_t uint8;
+	uint16_t uint16;
+	uint32_t uint32;
+	int8_t int8;
+	int16_t int16;
+	int32_t int32;
+} TupleValue;
+
+typedef struct __attribute__((__packed__)) Tuple {
+	uint32_t key;
+	TupleType type:8;
+	uint16_t length;
+	TupleValue value[];
+} Tuple;
+
+typedef struct DictionaryIterator {
+	uint8_t *begin;
+	uint8_t *end;
+	Tuple *cursor;
+} DictionaryIterator;
+
+Tuple *dict_read_first(DictionaryIterator *iter);
+Tuple *dict_read_next(DictionaryIterator *iter);
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+
+typedef enum {
+	DICT_OK = 0,
+	DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+	DICT_INVALID_ARGS = 1 << 2,
+} DictionaryResult;
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+    const uint8_t *data, const uint16_t size);
+
+typedef enum {
+	APP_MSG_OK = 0,
+	APP_MSG_SEND_TIMEOUT = 1 << 1,
+	APP_MSG_BUSY = 1 << 10,
+	APP_MSG_OUT_OF_MEMORY = 1 << 8,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator,
+    void *context);
+
+AppMessageInboxReceived app_message_register_inbox_received(
+    AppMessageInboxReceived received_callback);
+AppMessageResult app_message_open(const uint32_t size_inbound,
+    const uint32_t size_outbound);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+
+/****************
+ * SHIM CONTROL *
+ ****************/
+
+struct shim_stats {
+	unsigned long frames;
+	unsigned long layer_updates;
+	unsigned long lines;
+	unsigned long pixel_calls;
+	unsigned long rects;
+	unsigned long circles;
+	unsigned long path_fills;
+	unsigned long path_outlines;
+	unsigned long texts;
+	unsigned long bitmaps;
+	unsigned long captures;
+	unsigned long pixels;
+	unsigned long bytes_copied;
+	unsigned long persist_writes;
+	unsigned long persist_bytes;
+	unsigned long vibrations;
+	unsigned long wakeups;
+	unsigned long outbox_messages;
+	unsigned long outbox_bytes;
+};
+
+extern struct shim_stats shim_stats;
+
+void *shim_memcpy(void *dest, const void *src, size_t n);
+void *shim_memset(void *dest, int c, size_t n);
+size_t shim_frame_buffer_size(void);
+const uint8_t *shim_frame_buffer(void);
+void shim_render(void);
+void shim_tick(struct tm *tick_time);
+void shim_set_battery(uint8_t percent);
+void shim_set_connection(bool connected);
+void shim_set_accel(int16_t x, int16_t y, int16_t z);
+void shim_tap(void);
+void shim_advance(uint32_t elapsed_ms);
+void shim_dict_init(DictionaryIterator *iter, uint8_t *buffer, size_t size);
+void shim_dict_add_uint(DictionaryIterator *iter, uint32_t key,
+    uint32_t value);
+void shim_dict_add_cstring(DictionaryIterator *iter, uint32_t key,
+    const char *value);
+void shim_dict_add_data(DictionaryIterator *iter, uint32_t key,
+    const uint8_t *data, uint16_t size);
+uint32_t shim_inbox_size(void);
+uint32_t shim_outbox_size(void);
+DictionaryIterator *shim_outbox(void);
+void shim_inbox(DictionaryIterator *iter);
+
+#endif /* SHIM_PEBBLE_H */
@@ -17,7 +17,157 @@
 
 #include <pebble.h>
 
+#include "geometry.h"
+
 #define CACHE_BACKGROUND
+#define SINGLE_LAYER
+
+/*******************
+ * ENERGY COUNTERS *
+ *******************/
+
+/*
+ * Cheap in-RAM counts of the events costing energy, so that battery
+ * complaints can be matched with real activity. They are persisted on
+ * exit and at most hourly, and sent to the phone when it asks for them.
+ */
+enum energy_counter {
+	COUNT_FRAMES,
+	COUNT_MARKS_DRAWS,
+	COUNT_ICONS_DRAWS,
+	COUNT_TEXT_DRAWS,
+	COUNT_HANDS_DRAWS,
+	COUNT_SECONDS_DRAWS,
+	COUNT_PIN_DRAWS,
+	COUNT_CACHE_HITS,
+	COUNT_CACHE_MISSES,
+	COUNT_CACHE_SAVES,
+	COUNT_CONFIG_WRITES,
+	COUNT_VIBRATIONS,
+	COUNT_CONNECTION_TOGGLES,
+	COUNTER_NUMBER,
+};
+
+#define COUNTERS_KEY 2
+#define COUNTERS_FLUSH_INTERVAL 3600
+
+static uint32_t energy_counters[COUNTER_NUMBER];
+static bool energy_counters_dirty = false;
+static time_t energy_counters_flushed = 0;
+
+#define COUNT_EVENT(counter) do { \
+	energy_counters[(counter)] += 1; \
+	energy_counters_dirty = true; \
+	} while (0)
+
+/* counters added by later versions start from zero */
+static void
+read_energy_counters(void) {
+	int i = persist_read_data(COUNTERS_KEY,
+	    energy_counters, sizeof energy_counters);
+
+	if (i != E_DOES_NOT_EXIST && (i < 0 || i % sizeof(uint32_t))) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "invalid energy counters size %d", i);
+		memset(energy_counters, 0, sizeof energy_counters);
+	}
+
+	energy_counters_flushed = time(0);
+}
+
+static void
+write_energy_counters(bool force) {
+	time_t now = time(0);
+	int i;
+
+	if (!energy_counters_dirty
+	    || (!force && now - energy_counters_flushed
+	     < COUNTERS_FLUSH_INTERVAL))
+		return;
+
+	i = persist_write_data(COUNTERS_KEY,
+	    energy_counters, sizeof energy_counters);
+
+	if (i != (int)sizeof energy_counters) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "error while writing energy counters (%d)", i);
+		return;
+	}
+
+	energy_counters_dirty = false;
+	energy_counters_flushed = now;
+}
+
+/****************
+ * FRAME TIMING *
+ ****************/
+
+/*
+ * Log-scale histograms of the drawing time of each element since launch,
+ * bucket 0 holding durations below 1 ms and bucket i those from 2^(i-1)
+ * ms, the last one being open-ended. Counts saturate instead of wrapping.
+ */
+enum frame_timing {
+	TIME_BACKGROUND,
+	TIME_MARKS,
+	TIME_HANDS,
+	TIME_ICONS,
+	TIME_TEXT,
+	TIMING_NUMBER,
+};
+
+#define TIMING_BUCKETS 8
+
+static uint16_t frame_timings[TIMING_NUMBER][TIMING_BUCKETS];
+
+static uint32_t
+clock_ms(void) {
+	time_t seconds;
+	uint16_t milliseconds = time_ms(&seconds, 0);
+
+	return (uint32_t)seconds * 1000 + milliseconds;
+}
+
+static void
+record_timing(enum frame_timing timing, uint32_t start) {
+	uint32_t elapsed = clock_ms() - start;
+	unsigned bucket = 0;
+
+	while (elapsed && bucket < TIMING_BUCKETS - 1) {
+		elapsed >>= 1;
+		bucket += 1;
+	}
+
+	if (frame_timings[timing][bucket] < UINT16_MAX)
+		frame_timings[timing][bucket] += 1;
+}
+
+#define OUTBOX_SIZE dict_calc_buffer_size(2, \
+	    sizeof energy_counters, sizeof frame_timings)
+
+/*
+ * Replies to the phone with the requested raw little-endian arrays, in a
+ * single message so that a second reply cannot find the outbox busy.
+ */
+static void
+send_statistics(bool counters, bool timings) {
+	DictionaryIterator *iterator;
+	AppMessageResult result = app_message_outbox_begin(&iterator);
+
+	if (result != APP_MSG_OK) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "unable to send statistics (%d)", (int)result);
+		return;
+	}
+
+	if (counters)
+		dict_write_data(iterator, 24,
+		    (const uint8_t *)energy_counters, sizeof energy_counters);
+	if (timings)
+		dict_write_data(iterator, 25,
+		    (const uint8_t *)frame_timings, sizeof frame_timings);
+	app_message_outbox_send();
+}
 
 /**********************
  * CONFIGURABLE STATE *
@@ -36,9 +186,17 @@ static GColor minute_mark_color;
 static GColor text_color;
 static unsigned text_font = 0;
 static char text_format[32] = "%a %d";
+static TimeUnits text_update_unit = DAY_UNIT;
 static bool bluetooth_vibration = true;
 static uint8_t show_battery_icon_below = 100;
-#define PERSIST_BUFFER_SIZE 47
+static uint8_t quiet_start_hour = 0;
+static uint8_t quiet_end_hour = 0;
+static uint8_t idle_minutes = 0;
+static uint8_t seconds_hand_duration = 0;
+static uint8_t bluetooth_hysteresis = 0;
+static uint8_t vibrations_per_hour = 0;
+static uint8_t preset_switching = 0;
+#define PERSIST_BUFFER_SIZE 64
 #define TEXT_FONT_NUMBER 4
 
 static const char *const text_fonts[] = {
@@ -62,126 +220,489 @@ static const uint16_t text_heights[] = {
 	33,
 };
 
+/*
+ * Finest time unit the output of a strftime format depends on, or 0 when
+ * it never changes. Unknown conversions are assumed to change every minute.
+ */
+static TimeUnits
+format_update_unit(const char *format) {
+	TimeUnits result = 0, unit;
+
+	while (*format) {
+		if (*format++ != '%') continue;
+
+		/* flags, field width and locale modifiers */
+		while (*format == '-' || *format == '_' || *format == '0'
+		    || *format == '^' || *format == '#'
+		    || (*format >= '1' && *format <= '9')
+		    || *format == 'E' || *format == 'O')
+			format += 1;
+
+		switch (*format) {
+		    case 0:
+			return result;
+		    case 'n': case 't': case '%': case 'z': case 'Z':
+			unit = 0;
+			break;
+		    case 'C': case 'y': case 'Y':
+			unit = YEAR_UNIT;
+			break;
+		    case 'b': case 'B': case 'h': case 'm':
+			unit = MONTH_UNIT;
+			break;
+		    case 'a': case 'A': case 'd': case 'D': case 'e': case 'F':
+		    case 'g': case 'G': case 'j': case 'u': case 'U': case 'V':
+		    case 'w': case 'W': case 'x':
+			unit = DAY_UNIT;
+			break;
+		    case 'H': case 'I': case 'k': case 'l': case 'p': case 'P':
+			unit = HOUR_UNIT;
+			break;
+		    default:
+			unit = MINUTE_UNIT;
+			break;
+		}
+
+		format += 1;
+		if (unit && (!result || unit < result)) result = unit;
+	}
+
+	return result;
+}
+
 #ifdef PBL_SDK_3
 #define IS_VISIBLE(color) ((color).argb != background_color.argb)
 #define IS_EQUAL(color1, color2) ((color1).argb == (color2).argb)
 #define READ_COLOR(color, byte) do { (color).argb = (byte); } while (0)
-#define SAVE_COLOR(byte, color) do { (byte) = (color).argb; } while (0)
+#define PACK_COLOR(color) \
+	((((color).argb >> 6) == 3 ? 0x40 : 0) | ((color).argb & 0x3f))
+#define UNPACK_COLOR(color, bits) do { (color).argb \
+	= (((bits) & 0x40) ? 0xc0 : 0) | ((bits) & 0x3f); } while (0)
+#define IS_WHITE(color) ((color).r + (color).g + (color).b >= 6)
+#define COLOR_KEY(color) ((uint32_t)(color).argb)
 #elif PBL_SDK_2
 #define IS_VISIBLE(color) ((color) != background_color)
 #define IS_EQUAL(color1, color2) ((color1) == (color2))
 #define READ_COLOR(color, byte) do { (color) = (byte); } while (0)
-#define SAVE_COLOR(byte, color) do { (byte) = (color); } while (0)
+#define PACK_COLOR(color) \
+	((color) == GColorWhite ? 0x7f : (color) == GColorBlack ? 0x40 : 0)
+#define UNPACK_COLOR(color, bits) do { (color) = !((bits) & 0x40) \
+	? GColorClear : ((bits) & 0x3f) ? GColorWhite : GColorBlack; } while (0)
+#define IS_WHITE(color) ((color) == GColorWhite)
+#define COLOR_KEY(color) ((uint32_t)(uint8_t)(color))
 #endif
 
+/* snapshot of every configurable setting, to stage and compare changes */
+struct config {
+	GColor background_color;
+	GColor battery_color;
+	GColor battery_color2;
+	GColor bluetooth_color;
+	GColor hour_hand_color;
+	GColor minute_hand_color;
+	GColor pin_color;
+	GColor hour_mark_color;
+	GColor inner_rectangle_color;
+	GColor minute_mark_color;
+	GColor text_color;
+	uint8_t text_font;
+	char text_format[sizeof text_format];
+	bool bluetooth_vibration;
+	uint8_t show_battery_icon_below;
+	uint8_t quiet_start_hour;
+	uint8_t quiet_end_hour;
+	uint8_t idle_minutes;
+	uint8_t seconds_hand_duration;
+	uint8_t bluetooth_hysteresis;
+	uint8_t vibrations_per_hour;
+	uint8_t preset_switching;
+};
+
 static void
-read_config(void) {
-	uint8_t buffer[PERSIST_BUFFER_SIZE + 1];
-	int i;
+get_config(struct config *config) {
+	memset(config, 0, sizeof *config);
+	config->background_color = background_color;
+	config->battery_color = battery_color;
+	config->battery_color2 = battery_color2;
+	config->bluetooth_color = bluetooth_color;
+	config->hour_hand_color = hour_hand_color;
+	config->minute_hand_color = minute_hand_color;
+	config->pin_color = pin_color;
+	config->hour_mark_color = hour_mark_color;
+	config->inner_rectangle_color = inner_rectangle_color;
+	config->minute_mark_color = minute_mark_color;
+	config->text_color = text_color;
+	config->text_font = text_font;
+	memcpy(config->text_format, text_format, sizeof text_format);
+	config->bluetooth_vibration = bluetooth_vibration;
+	config->show_battery_icon_below = show_battery_icon_below;
+	config->quiet_start_hour = quiet_start_hour;
+	config->quiet_end_hour = quiet_end_hour;
+	config->idle_minutes = idle_minutes;
+	config->seconds_hand_duration = seconds_hand_duration;
+	config->bluetooth_hysteresis = bluetooth_hysteresis;
+	config->vibrations_per_hour = vibrations_per_hour;
+	config->preset_switching = preset_switching;
+}
 
-	i = persist_read_data(1, buffer, sizeof buffer);
+static void
+set_config(const struct config *config) {
+	background_color = config->background_color;
+	battery_color = config->battery_color;
+	battery_color2 = config->battery_color2;
+	bluetooth_color = config->bluetooth_color;
+	hour_hand_color = config->hour_hand_color;
+	minute_hand_color = config->minute_hand_color;
+	pin_color = config->pin_color;
+	hour_mark_color = config->hour_mark_color;
+	inner_rectangle_color = config->inner_rectangle_color;
+	minute_mark_color = config->minute_mark_color;
+	text_color = config->text_color;
+	text_font = config->text_font;
+	memcpy(text_format, config->text_format, sizeof text_format);
+	bluetooth_vibration = config->bluetooth_vibration;
+	show_battery_icon_below = config->show_battery_icon_below;
+	quiet_start_hour = config->quiet_start_hour;
+	quiet_end_hour = config->quiet_end_hour;
+	idle_minutes = config->idle_minutes;
+	seconds_hand_duration = config->seconds_hand_duration;
+	bluetooth_hysteresis = config->bluetooth_hysteresis;
+	vibrations_per_hour = config->vibrations_per_hour;
+	preset_switching = config->preset_switching;
+}
 
-	if (i == E_DOES_NOT_EXIST) return;
+/*
+ * Persistent storage, since version 7: a version byte followed by the
+ * fields of config_schema packed least significant bit first, colors on
+ * 7 bits (opacity and rgb) and the text format as a 5-bit length and its
+ * bytes. Versions 1 to 6 used fixed byte offsets and are migrated on load.
+ */
 
-	if (i < 1) {
-		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "invalid persist buffer size %d", i);
-		return;
+#define CONFIG_VERSION 8
+#define SCHEMA_FIRST_VERSION 7
+
+enum config_field_type {
+	FIELD_COLOR,
+	FIELD_BOOL,
+	FIELD_UINT,
+	FIELD_STRING,
+};
+
+/* fields are only present from the "since" version of the schema */
+struct config_field {
+	uint8_t type;
+	uint8_t bits;
+	uint8_t since;
+	uint16_t offset;
+};
+
+#define CONFIG_FIELD_SINCE(since, type, bits, name) \
+	{ (type), (bits), (since), offsetof(struct config, name) }
+#define CONFIG_FIELD(type, bits, name) \
+	CONFIG_FIELD_SINCE(SCHEMA_FIRST_VERSION, type, bits, name)
+
+static const struct config_field config_schema[] = {
+	CONFIG_FIELD(FIELD_COLOR,  7, background_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, battery_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, battery_color2),
+	CONFIG_FIELD(FIELD_COLOR,  7, bluetooth_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, hour_hand_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, minute_hand_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, pin_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, hour_mark_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, inner_rectangle_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, minute_mark_color),
+	CONFIG_FIELD(FIELD_COLOR,  7, text_color),
+	CONFIG_FIELD(FIELD_UINT,   2, text_font),
+	CONFIG_FIELD(FIELD_BOOL,   1, bluetooth_vibration),
+	CONFIG_FIELD(FIELD_UINT,   8, show_battery_icon_below),
+	CONFIG_FIELD(FIELD_UINT,   5, quiet_start_hour),
+	CONFIG_FIELD(FIELD_UINT,   5, quiet_end_hour),
+	CONFIG_FIELD(FIELD_UINT,   8, idle_minutes),
+	CONFIG_FIELD(FIELD_UINT,   8, seconds_hand_duration),
+	CONFIG_FIELD(FIELD_UINT,   8, bluetooth_hysteresis),
+	CONFIG_FIELD(FIELD_UINT,   8, vibrations_per_hour),
+	CONFIG_FIELD_SINCE(8, FIELD_UINT, 2, preset_switching),
+	CONFIG_FIELD(FIELD_STRING, 5, text_format),
+};
+
+/* encoded bytes currently in storage, to skip identical writes */
+static uint8_t stored_config[PERSIST_BUFFER_SIZE];
+static int stored_config_size = 0;
+
+static void
+put_bits(uint8_t *buffer, size_t *position, uint32_t value, uint8_t bits) {
+	for (; bits > 0; bits -= 1, value >>= 1, *position += 1)
+		if (value & 1) buffer[*position / 8] |= 1 << (*position % 8);
+}
+
+/* reads bits from the buffer, moving position past its end on overflow */
+static uint32_t
+get_bits(const uint8_t *buffer, size_t size, size_t *position,
+    uint8_t bits) {
+	uint32_t result = 0;
+	uint8_t i;
+
+	if (*position + bits > size * 8) {
+		*position = size * 8 + 1;
+		return 0;
 	}
 
-	if (buffer[0] < 1) {
-		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "invalid configuration version %u", (unsigned)(buffer[0]));
-		return;
+	for (i = 0; i < bits; i += 1, *position += 1)
+		if (buffer[*position / 8] & (1 << (*position % 8)))
+			result |= 1u << i;
+
+	return result;
+}
+
+/* returns the encoded size, buffer holding PERSIST_BUFFER_SIZE bytes */
+static size_t
+encode_config(const struct config *config, uint8_t *buffer) {
+	const uint8_t *base = (const uint8_t *)config;
+	const struct config_field *field;
+	size_t position = 8, i, j, length;
+
+	memset(buffer, 0, PERSIST_BUFFER_SIZE);
+	buffer[0] = CONFIG_VERSION;
+
+	for (i = 0; i < sizeof config_schema / sizeof *config_schema; i += 1) {
+		field = &config_schema[i];
+		switch (field->type) {
+		    case FIELD_COLOR:
+			put_bits(buffer, &position,
+			    PACK_COLOR(*(const GColor *)(base + field->offset)),
+			    field->bits);
+			break;
+		    case FIELD_BOOL:
+			put_bits(buffer, &position,
+			    *(const bool *)(base + field->offset) ? 1 : 0,
+			    field->bits);
+			break;
+		    case FIELD_UINT:
+			put_bits(buffer, &position, base[field->offset],
+			    field->bits);
+			break;
+		    case FIELD_STRING:
+			length = strlen((const char *)(base + field->offset));
+			put_bits(buffer, &position, length, field->bits);
+			for (j = 0; j < length; j += 1)
+				put_bits(buffer, &position,
+				    base[field->offset + j], 8);
+			break;
+		}
 	}
 
-	if (buffer[0] > 3) {
-		APP_LOG(APP_LOG_LEVEL_WARNING,
-		    "loading data from future version %u, "
-		    "data will be lost on the next write",
-		    (unsigned)(buffer[0]));
-		return;
+	return (position + 7) / 8;
+}
+
+static bool
+decode_config(const uint8_t *buffer, size_t size, struct config *output) {
+	struct config config = *output;
+	uint8_t *base = (uint8_t *)&config;
+	const struct config_field *field;
+	size_t position = 8, i, j;
+	uint32_t value;
+
+	if (size < 1 || buffer[0] < SCHEMA_FIRST_VERSION
+	    || buffer[0] > CONFIG_VERSION)
+		return false;
+
+	for (i = 0; i < sizeof config_schema / sizeof *config_schema; i += 1) {
+		field = &config_schema[i];
+		if (field->since > buffer[0]) continue;
+		value = get_bits(buffer, size, &position, field->bits);
+		switch (field->type) {
+		    case FIELD_COLOR:
+			UNPACK_COLOR(*(GColor *)(base + field->offset), value);
+			break;
+		    case FIELD_BOOL:
+			*(bool *)(base + field->offset) = (value != 0);
+			break;
+		    case FIELD_UINT:
+			base[field->offset] = value;
+			break;
+		    case FIELD_STRING:
+			if (value >= sizeof text_format) return false;
+			for (j = 0; j < value; j += 1)
+				base[field->offset + j] = get_bits(buffer,
+				    size, &position, 8);
+			memset(base + field->offset + value, 0,
+			    sizeof text_format - value);
+			break;
+		}
 	}
 
-	if (i < 43) {
+	if (position > size * 8) return false;
+
+	*output = config;
+	return true;
+}
+
+/* fixed offset layout of versions 1 to 6, fields added at each version */
+static void
+decode_legacy_config(const uint8_t *buffer, int size,
+    struct config *config) {
+	if (size < 43) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
-		    "truncated persistent buffer size at %d, aborting", i);
+		    "truncated persistent buffer size at %d, aborting", size);
 		return;
 	}
 
-	READ_COLOR(background_color,      buffer[1]);
-	READ_COLOR(battery_color,         buffer[2]);
-	READ_COLOR(bluetooth_color,       buffer[3]);
-	READ_COLOR(hour_hand_color,       buffer[4]);
-	READ_COLOR(hour_mark_color,       buffer[5]);
-	READ_COLOR(inner_rectangle_color, buffer[6]);
-	READ_COLOR(minute_mark_color,     buffer[7]);
-	READ_COLOR(text_color,            buffer[8]);
+	READ_COLOR(config->background_color,      buffer[1]);
+	READ_COLOR(config->battery_color,         buffer[2]);
+	READ_COLOR(config->bluetooth_color,       buffer[3]);
+	READ_COLOR(config->hour_hand_color,       buffer[4]);
+	READ_COLOR(config->hour_mark_color,       buffer[5]);
+	READ_COLOR(config->inner_rectangle_color, buffer[6]);
+	READ_COLOR(config->minute_mark_color,     buffer[7]);
+	READ_COLOR(config->text_color,            buffer[8]);
 
-	bluetooth_vibration = (buffer[9] != 0);
-	show_battery_icon_below = buffer[10];
+	config->bluetooth_vibration = (buffer[9] != 0);
+	config->show_battery_icon_below = buffer[10];
 
-	memcpy(text_format, buffer + 11, sizeof text_format);
+	memcpy(config->text_format, buffer + 11, sizeof text_format);
+	config->text_format[sizeof text_format - 1] = 0;
 
-	battery_color2 = battery_color;
-	pin_color = minute_hand_color = hour_hand_color;
+	config->battery_color2 = config->battery_color;
+	config->pin_color = config->minute_hand_color
+	    = config->hour_hand_color;
 
 	if (buffer[0] < 2) return;
 
-	if (i < 45) {
+	if (size < 45) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
 		    "truncated persistent buffer (size %d), using only v1",
-		    i);
+		    size);
 		return;
 	}
 
-	READ_COLOR(battery_color2, buffer[43]);
-	text_font = buffer[44];
+	READ_COLOR(config->battery_color2, buffer[43]);
+	config->text_font = (buffer[44] < TEXT_FONT_NUMBER) ? buffer[44] : 0;
 
 	if (buffer[0] < 3) return;
 
-	if (i < 47) {
+	if (size < 47) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
 		    "truncated persistent buffer (size %d), using only v2",
-		    i);
+		    size);
+		return;
+	}
+
+	READ_COLOR(config->minute_hand_color, buffer[45]);
+	READ_COLOR(config->pin_color, buffer[46]);
+
+	if (buffer[0] < 4) return;
+
+	if (size < 50) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "truncated persistent buffer (size %d), using only v3",
+		    size);
+		return;
+	}
+
+	config->quiet_start_hour = buffer[47];
+	config->quiet_end_hour = buffer[48];
+	config->idle_minutes = buffer[49];
+
+	if (buffer[0] < 5) return;
+
+	if (size < 51) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "truncated persistent buffer (size %d), using only v4",
+		    size);
+		return;
+	}
+
+	config->seconds_hand_duration = buffer[50];
+
+	if (buffer[0] < 6) return;
+
+	if (size < 53) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "truncated persistent buffer (size %d), using only v5",
+		    size);
 		return;
 	}
 
-	READ_COLOR(minute_hand_color, buffer[45]);
-	READ_COLOR(pin_color, buffer[46]);
+	config->bluetooth_hysteresis = buffer[51];
+	config->vibrations_per_hour = buffer[52];
 }
 
+static void write_config(void);
+
 static void
-write_config(void) {
-	uint8_t buffer[PERSIST_BUFFER_SIZE];
+read_config(void) {
+	uint8_t buffer[PERSIST_BUFFER_SIZE + 1];
+	struct config config;
 	int i;
 
-	buffer[0] = 3;
-	SAVE_COLOR(buffer[1], background_color);
-	SAVE_COLOR(buffer[2], battery_color);
-	SAVE_COLOR(buffer[3], bluetooth_color);
-	SAVE_COLOR(buffer[4], hour_hand_color);
-	SAVE_COLOR(buffer[45], minute_hand_color);
-	SAVE_COLOR(buffer[46], pin_color);
-	SAVE_COLOR(buffer[5], hour_mark_color);
-	SAVE_COLOR(buffer[6], inner_rectangle_color);
-	SAVE_COLOR(buffer[7], minute_mark_color);
-	SAVE_COLOR(buffer[8], text_color);
+	i = persist_read_data(1, buffer, sizeof buffer);
+
+	if (i == E_DOES_NOT_EXIST) return;
+
+	if (i < 1 || i > PERSIST_BUFFER_SIZE) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "invalid persist buffer size %d", i);
+		return;
+	}
+
+	if (buffer[0] < 1) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "invalid configuration version %u", (unsigned)(buffer[0]));
+		return;
+	}
+
+	if (buffer[0] > CONFIG_VERSION) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "loading data from future version %u, "
+		    "data will be lost on the next write",
+		    (unsigned)(buffer[0]));
+		return;
+	}
+
+	get_config(&config);
+
+	if (buffer[0] < SCHEMA_FIRST_VERSION) {
+		decode_legacy_config(buffer, i, &config);
+		set_config(&config);
+		write_config();
+	} else if (decode_config(buffer, i, &config)) {
+		set_config(&config);
+		memcpy(stored_config, buffer, i);
+		stored_config_size = i;
+	} else {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "invalid packed configuration of size %d", i);
+		return;
+	}
+
+	text_update_unit = format_update_unit(text_format);
+}
 
-	buffer[9] = bluetooth_vibration ? 1 : 0;
-	buffer[10] = show_battery_icon_below;
+static void
+write_config(void) {
+	uint8_t buffer[PERSIST_BUFFER_SIZE];
+	struct config config;
+	int i, size;
 
-	memcpy(buffer + 11, text_format, sizeof text_format);
+	get_config(&config);
+	size = encode_config(&config, buffer);
 
-	SAVE_COLOR(buffer[43], battery_color2);
-	buffer[44] = text_font;
+	if (size == stored_config_size
+	    && !memcmp(buffer, stored_config, size))
+		return;
 
-	i = persist_write_data(1, buffer, sizeof buffer);
+	i = persist_write_data(1, buffer, size);
 
-	if (i < 0 || (size_t)i != sizeof buffer) {
+	if (i != size) {
 		APP_LOG(APP_LOG_LEVEL_ERROR,
 		    "error while writing to persistent storage (%d)", i);
+		return;
 	}
+
+	COUNT_EVENT(COUNT_CONFIG_WRITES);
+	memcpy(stored_config, buffer, size);
+	stored_config_size = size;
 }
 
 static GColor
@@ -246,6 +767,31 @@ color_from_tuple(Tuple *tuple) {
 #endif
 }
 
+/* stores an integer entry below limit into output, or logs the error */
+static void
+read_small_uint(Tuple *tuple, unsigned limit, const char *name,
+    uint8_t *output) {
+	int32_t value;
+
+	if (tuple->type == TUPLE_INT)
+		value = tuple->value->int8;
+	else if (tuple->type == TUPLE_UINT)
+		value = tuple->value->uint8;
+	else {
+		APP_LOG(APP_LOG_LEVEL_ERROR, "bad type %d for %s entry",
+		    (int)tuple->type, name);
+		return;
+	}
+
+	if (value < 0 || (unsigned)value >= limit) {
+		APP_LOG(APP_LOG_LEVEL_ERROR, "bad value %ld for %s entry",
+		    (long)value, name);
+		return;
+	}
+
+	*output = value;
+}
+
 /*****************
  * HELPER MACROS *
  *****************/
@@ -286,47 +832,120 @@ static const GPathInfo minute_hand_path_points
 static const GPathInfo hour_hand_path_points
 	= QUAD_PATH_POINTS(17, 8, -58, -8);
 #endif
-static const GPathInfo bluetooth_logo_points = { 7, (GPoint[]) {
+static const GPathInfo seconds_hand_path_points = { 2, (GPoint[]) {
+	{ 0, PBL_IF_RECT_ELSE(15, 17) },
+	{ 0, PBL_IF_RECT_ELSE(-70, -81) } } };
+static const GPoint bluetooth_logo_points[] = {
 	{ -3, -3 },
 	{  3,  3 },
 	{  0,  6 },
 	{  0, -6 },
 	{  3, -3 },
 	{ -3,  3 },
-	{  0,  0 } } };
-static const GPathInfo bluetooth_frame_points = { 3, (GPoint[]) {
+	{  0,  0 } };
+static const GPoint bluetooth_frame_points[] = {
 	{ -13,   9 },
 	{   0, -14 },
-	{  13,   9 } } };
+	{  13,   9 },
+	{ -13,   9 } };
 
 static struct tm tm_now;
 static bool bluetooth_connected = 0;
+static bool bluetooth_link = 0;
+static AppTimer *bluetooth_timer = 0;
+static time_t vibration_window_start = 0;
+static uint8_t vibration_count = 0;
 static Window *window;
 static Layer *background_layer;
-static Layer *hand_layer;
+#ifndef SINGLE_LAYER
+static Layer *hour_hand_layer;
+static Layer *minute_hand_layer;
+static Layer *pin_layer;
+static Layer *seconds_hand_layer;
 static Layer *icon_layer;
-static TextLayer *text_layer;
-static GPath *bluetooth_frame;
-static GPath *bluetooth_logo;
-static GPath *hour_hand_path;
-static GPath *minute_hand_path;
+#ifdef CACHE_BACKGROUND
+static Layer *cache_layer;
+#endif
+static Layer *text_layer;
+#endif
+static GRect icon_frame;
+static GRect text_frame;
+static bool icon_hidden = true;
+static bool text_hidden = true;
+static bool bluetooth_icon_shown = false;
+static bool battery_icon_shown = false;
+
+/* fingerprints of exactly what each element renders */
+static uint32_t marks_key;
+static uint32_t icon_key;
+static uint32_t text_key;
+static uint32_t hands_key;
+static uint32_t pin_key;
+static GBitmap *bluetooth_icon;
+static GBitmap *battery_icon;
+static uint32_t bluetooth_icon_key;
+static uint32_t battery_icon_key;
 static GPoint center;
+static GPoint hour_hand_points[4];
+static GPoint minute_hand_points[4];
+static const GPathInfo hour_hand_rotated = { 4, hour_hand_points };
+static const GPathInfo minute_hand_rotated = { 4, minute_hand_points };
+static GRect hour_hand_box;
+static GRect minute_hand_box;
+static uint8_t seconds_hand_segment[4];
+static GRect seconds_hand_box;
+static bool seconds_hand_shown = false;
+static time_t seconds_hand_until;
 static char text_buffer[64];
+static GFont text_layer_font;
 static uint8_t current_battery = 100;
+static bool reduced_rendering = false;
 #define has_battery (current_battery > show_battery_icon_below)
-#define ICON_LAYER_SET_HIDDEN  do { \
-	layer_set_hidden(icon_layer, \
-	    (bluetooth_connected || !IS_VISIBLE(bluetooth_color)) \
-	    && (has_battery \
-	     || !(IS_VISIBLE(battery_color) || IS_VISIBLE(battery_color2)))); \
-	} while (0)
+#define BACKGROUND_IS_PLAIN (!IS_VISIBLE(inner_rectangle_color) \
+	    && !IS_VISIBLE(hour_mark_color) \
+	    && !IS_VISIBLE(minute_mark_color))
+#define PIN_FRAME GRect(center.x - 2, center.y - 2, 5, 5)
+
+static GRect
+grect_union(GRect a, GRect b) {
+	int16_t x0, y0, x1, y1;
+
+	if (a.size.w <= 0 || a.size.h <= 0) return b;
+	if (b.size.w <= 0 || b.size.h <= 0) return a;
+
+	x0 = (a.origin.x < b.origin.x) ? a.origin.x : b.origin.x;
+	y0 = (a.origin.y < b.origin.y) ? a.origin.y : b.origin.y;
+	x1 = (a.origin.x + a.size.w > b.origin.x + b.size.w)
+	    ? a.origin.x + a.size.w : b.origin.x + b.size.w;
+	y1 = (a.origin.y + a.size.h > b.origin.y + b.size.h)
+	    ? a.origin.y + a.size.h : b.origin.y + b.size.h;
+
+	return GRect(x0, y0, x1 - x0, y1 - y0);
+}
 
-#ifdef CACHE_BACKGROUND
-#define SCREEN_BUFFER_SIZE \
-    PBL_IF_RECT_ELSE(PBL_IF_COLOR_ELSE(144 * 168, 144 * 168 / 8), 25868)
+#ifdef SINGLE_LAYER
+static bool
+grect_overlaps(GRect a, GRect b) {
+	return a.origin.x < b.origin.x + b.size.w
+	    && b.origin.x < a.origin.x + a.size.w
+	    && a.origin.y < b.origin.y + b.size.h
+	    && b.origin.y < a.origin.y + a.size.h;
+}
+#endif
 
-static uint8_t background_cache[SCREEN_BUFFER_SIZE];
-static bool use_background_cache = false;
+/* screen area that changed since the last frame */
+static GRect dirty_rect;
+
+/* any dirty layer makes the firmware render the whole window */
+static void
+mark_dirty(GRect frame) {
+	dirty_rect = grect_union(dirty_rect, frame);
+	layer_mark_dirty(background_layer);
+}
+
+/* aplite frame buffer rows are padded to 160 pixels */
+#define SCREEN_BUFFER_SIZE \
+    PBL_IF_RECT_ELSE(PBL_IF_COLOR_ELSE(144 * 168, 20 * 168), 25868)
 
 static size_t
 gbitmap_get_data_size(GBitmap *bitmap) {
@@ -338,7 +957,7 @@ gbitmap_get_data_size(GBitmap *bitmap) {
 	GBitmapDataRowInfo row_info;
 	switch (gbitmap_get_format(bitmap)) {
 	    case GBitmapFormat1Bit:
-		return bounds.size.w * bounds.size.h / 8;
+		return gbitmap_get_bytes_per_row(bitmap) * bounds.size.h;
 	    case GBitmapFormat8Bit:
 		return bounds.size.w * bounds.size.h;
 	    case GBitmapFormat8BitCircular:
@@ -349,353 +968,1629 @@ gbitmap_get_data_size(GBitmap *bitmap) {
 		return 0;
 	}
 #else
-	return bounds.size.w * bounds.size.h / 8;
+	return gbitmap_get_bytes_per_row(bitmap) * bounds.size.h;
 #endif
 }
 
-static bool
-save_frame_buffer(GContext *ctx) {
-	GBitmap *frame_buffer = graphics_capture_frame_buffer(ctx);
+/* frame buffer bytes holding columns x0 to x1 of row y, if any */
+static size_t
+frame_buffer_span(GBitmap *bitmap, int16_t y, int16_t x0, int16_t x1,
+    uint8_t **start) {
+#ifdef PBL_SDK_3
+	GBitmapDataRowInfo row_info = gbitmap_get_data_row_info(bitmap, y);
 
-	if (!frame_buffer) {
-		APP_LOG(APP_LOG_LEVEL_WARNING,
-		    "Unable to capture frame buffer for saving");
-		return false;
-	}
+	if (x0 < row_info.min_x) x0 = row_info.min_x;
+	if (x1 > row_info.max_x) x1 = row_info.max_x;
+	if (x1 < x0) return 0;
 
-	if (gbitmap_get_data_size(frame_buffer) != SCREEN_BUFFER_SIZE) {
-		APP_LOG(APP_LOG_LEVEL_WARNING,
-		    "Unexpected frame buffer size %u, expected %u",
-		    gbitmap_get_data_size(frame_buffer), SCREEN_BUFFER_SIZE);
-		graphics_release_frame_buffer(ctx, frame_buffer);
-		return false;
+	switch (gbitmap_get_format(bitmap)) {
+	    case GBitmapFormat1Bit:
+		*start = row_info.data + x0 / 8;
+		return x1 / 8 - x0 / 8 + 1;
+	    case GBitmapFormat8Bit:
+	    case GBitmapFormat8BitCircular:
+		*start = row_info.data + x0;
+		return x1 - x0 + 1;
+	    default:
+		return 0;
 	}
-
-	memcpy(background_cache, gbitmap_get_data(frame_buffer),
-	    sizeof background_cache);
-	use_background_cache = true;
-	graphics_release_frame_buffer(ctx, frame_buffer);
-	return true;
+#else
+	if (x1 < x0) return 0;
+	*start = gbitmap_get_data(bitmap)
+	    + y * gbitmap_get_bytes_per_row(bitmap) + x0 / 8;
+	return x1 / 8 - x0 / 8 + 1;
+#endif
 }
 
-static bool
-restore_frame_buffer(GContext *ctx) {
-	GBitmap *frame_buffer = graphics_capture_frame_buffer(ctx);
+/* writes color over columns x0 to x1 of row y, all within the screen */
+static void
+frame_buffer_fill_span(GBitmap *bitmap, int16_t y, int16_t x0, int16_t x1,
+    GColor color) {
+	uint8_t *start;
+	size_t size = frame_buffer_span(bitmap, y, x0, x1, &start);
+#ifdef PBL_BW
+	uint8_t first, last;
+	const bool white = IS_WHITE(color);
 
-	if (!frame_buffer) {
-		APP_LOG(APP_LOG_LEVEL_WARNING,
-		    "Unable to capture frame buffer for restore");
-		return false;
-	}
+	if (!size) return;
 
-	if (gbitmap_get_data_size(frame_buffer) != SCREEN_BUFFER_SIZE) {
-		APP_LOG(APP_LOG_LEVEL_WARNING,
-		    "Unexpected frame buffer size %u, expected %u",
-		    gbitmap_get_data_size(frame_buffer), SCREEN_BUFFER_SIZE);
+	/* pixels are stored least significant bit first */
+	first = 0xff << (x0 % 8);
+	last = 0xff >> (7 - x1 % 8);
+	if (size == 1) first &= last;
+
+	if (white) *start |= first; else *start &= ~first;
+	if (size == 1) return;
+	if (size > 2) memset(start + 1, white ? 0xff : 0x00, size - 2);
+	if (white) start[size - 1] |= last; else start[size - 1] &= ~last;
+#else
+	if (size) memset(start, color.argb, size);
+#endif
+}
+
+/* writes color over pixel (x, y), within the screen rectangle */
+static void
+frame_buffer_pixel(GBitmap *bitmap, int16_t x, int16_t y, GColor color) {
+#ifdef PBL_BW
+	uint8_t *byte = gbitmap_get_data(bitmap)
+	    + y * gbitmap_get_bytes_per_row(bitmap) + x / 8;
+
+	if (IS_WHITE(color)) *byte |= 1 << (x % 8);
+	else *byte &= ~(1 << (x % 8));
+#elif defined(PBL_ROUND)
+	GBitmapDataRowInfo row_info = gbitmap_get_data_row_info(bitmap, y);
+
+	if (x >= row_info.min_x && x <= row_info.max_x)
+		row_info.data[x] = color.argb;
+#else
+	gbitmap_get_data(bitmap)[y * gbitmap_get_bytes_per_row(bitmap) + x]
+	    = color.argb;
+#endif
+}
+
+/*
+ * Bresenham segment clipped to the screen, thick ones being three pixels
+ * across the minor axis.
+ */
+static void
+frame_buffer_line(GBitmap *bitmap, const uint8_t *segment, bool thick,
+    GColor color) {
+	const GRect bounds = gbitmap_get_bounds(bitmap);
+	int16_t x = segment[0], y = segment[1];
+	const int16_t x1 = segment[2], y1 = segment[3];
+	const int16_t dx = (x1 > x) ? x1 - x : x - x1;
+	const int16_t dy = (y1 > y) ? y1 - y : y - y1;
+	const int16_t step_x = (x1 > x) ? 1 : -1;
+	const int16_t step_y = (y1 > y) ? 1 : -1;
+	const int16_t across_x = (thick && dy > dx) ? 1 : 0;
+	const int16_t across_y = (thick && dy <= dx) ? 1 : 0;
+	int16_t error = dx - dy, double_error, px, py;
+	int i;
+
+	for (;;) {
+		for (i = -1; i <= 1; i += 1) {
+			if (!thick && i) continue;
+			px = x + i * across_x;
+			py = y + i * across_y;
+			if (px >= 0 && py >= 0
+			    && px < bounds.size.w && py < bounds.size.h)
+				frame_buffer_pixel(bitmap, px, py, color);
+		}
+
+		if (x == x1 && y == y1) break;
+
+		double_error = 2 * error;
+		if (double_error > -dy) {
+			error -= dy;
+			x += step_x;
+		}
+		if (double_error < dx) {
+			error += dx;
+			y += step_y;
+		}
+	}
+}
+
+#ifdef PBL_ROUND
+/* midpoint circle outline */
+static void
+frame_buffer_circle(GBitmap *bitmap, GPoint center, int16_t radius,
+    GColor color) {
+	int16_t x = radius, y = 0, error = 1 - radius;
+
+	while (y <= x) {
+		frame_buffer_pixel(bitmap, center.x + x, center.y + y, color);
+		frame_buffer_pixel(bitmap, center.x - x, center.y + y, color);
+		frame_buffer_pixel(bitmap, center.x + x, center.y - y, color);
+		frame_buffer_pixel(bitmap, center.x - x, center.y - y, color);
+		frame_buffer_pixel(bitmap, center.x + y, center.y + x, color);
+		frame_buffer_pixel(bitmap, center.x - y, center.y + x, color);
+		frame_buffer_pixel(bitmap, center.x + y, center.y - x, color);
+		frame_buffer_pixel(bitmap, center.x - y, center.y - x, color);
+
+		y += 1;
+		if (error < 0) {
+			error += 2 * y + 1;
+		} else {
+			x -= 1;
+			error += 2 * (y - x) + 1;
+		}
+	}
+}
+#endif
+
+/* leftmost and rightmost columns of a convex hand polygon on row y */
+static bool
+hand_row(const GPoint *points, const int32_t *slopes, int16_t y,
+    int16_t *left, int16_t *right) {
+	bool result = false;
+	int16_t x;
+	int i;
+
+	for (i = 0; i < 4; i += 1) {
+		const GPoint *a = &points[i];
+		const GPoint *b = &points[(i + 1) % 4];
+
+		if ((y < a->y && y < b->y) || (y > a->y && y > b->y)) continue;
+
+		if (a->y == b->y) {
+			x = (a->x < b->x) ? a->x : b->x;
+			if (!result || x < *left) *left = x;
+			x = (a->x < b->x) ? b->x : a->x;
+			if (!result || x > *right) *right = x;
+		} else {
+			/* 16.16 fixed point, multiplied as x may be negative */
+			x = ((int32_t)a->x * 65536 + (y - a->y) * slopes[i]
+			    + 0x8000) >> 16;
+			if (!result || x < *left) *left = x;
+			if (!result || x > *right) *right = x;
+		}
+
+		result = true;
+	}
+
+	return result;
+}
+
+/*
+ * Scanline rasterizer for the 4-vertex hands, writing the fill and its
+ * one-pixel border in a single pass. Border pixels are the covered ones
+ * not covered on the row above or below, or at either end of the row.
+ */
+static void
+draw_hand_spans(GBitmap *frame_buffer, const GPoint *points,
+    GColor fill_color, GColor border_color) {
+	const GRect bounds = gbitmap_get_bounds(frame_buffer);
+	int32_t slopes[4];
+	int16_t y, y0, y1, left, right, prev_left, prev_right;
+	int16_t next_left, next_right, fill_left, fill_right;
+	bool has_prev, has_next;
+	int i;
+
+	y0 = y1 = points[0].y;
+	for (i = 0; i < 4; i += 1) {
+		const GPoint *a = &points[i];
+		const GPoint *b = &points[(i + 1) % 4];
+
+		slopes[i] = (a->y == b->y) ? 0
+		    : (int32_t)(b->x - a->x) * 65536 / (b->y - a->y);
+		if (a->y < y0) y0 = a->y;
+		if (a->y > y1) y1 = a->y;
+	}
+
+	has_prev = false;
+	prev_left = prev_right = 0;
+	hand_row(points, slopes, y0, &left, &right);
+
+	for (y = y0; y <= y1; y += 1) {
+		has_next = (y < y1)
+		    && hand_row(points, slopes, y + 1, &next_left, &next_right);
+
+		if (!has_prev || !has_next) {
+			fill_left = right + 1;
+			fill_right = right;
+		} else {
+			fill_left = left + 1;
+			if (prev_left > fill_left) fill_left = prev_left;
+			if (next_left > fill_left) fill_left = next_left;
+			fill_right = right - 1;
+			if (prev_right < fill_right) fill_right = prev_right;
+			if (next_right < fill_right) fill_right = next_right;
+			if (fill_right < fill_left) fill_left = right + 1;
+		}
+
+		if (center.y + y >= 0 && center.y + y < bounds.size.h) {
+			int16_t x0 = center.x + left, x1 = center.x + right;
+			int16_t f0 = center.x + fill_left;
+			int16_t f1 = center.x + fill_right;
+
+			if (x0 < 0) x0 = 0;
+			if (x1 >= bounds.size.w) x1 = bounds.size.w - 1;
+			if (f0 < x0) f0 = x0;
+			if (f1 > x1) f1 = x1;
+
+			if (f0 > f1) {
+				frame_buffer_fill_span(frame_buffer,
+				    center.y + y, x0, x1, border_color);
+			} else {
+				frame_buffer_fill_span(frame_buffer,
+				    center.y + y, x0, f0 - 1, border_color);
+				frame_buffer_fill_span(frame_buffer,
+				    center.y + y, f0, f1, fill_color);
+				frame_buffer_fill_span(frame_buffer,
+				    center.y + y, f1 + 1, x1, border_color);
+			}
+		}
+
+		has_prev = true;
+		prev_left = left;
+		prev_right = right;
+		left = next_left;
+		right = next_right;
+	}
+}
+
+#ifdef CACHE_BACKGROUND
+/*
+ * The cache is a heap block starting with the offset of each row in the
+ * run area (plus one for the end), followed by (length, value) byte runs
+ * encoding the frame buffer rows. It is only allocated while valid.
+ */
+static uint16_t *background_cache = 0;
+static bool use_background_cache = false;
+
+static void
+free_background_cache(void) {
+	free(background_cache);
+	background_cache = 0;
+}
+
+/* run-length encodes data into output (when not NULL), returns its size */
+static size_t
+encode_runs(const uint8_t *data, size_t size, uint8_t *output) {
+	size_t i, result = 0;
+	uint8_t length = 0;
+
+	for (i = 0; i <= size; i += 1) {
+		if (i < size && length > 0 && length < 255
+		    && data[i] == data[i - 1]) {
+			length += 1;
+			continue;
+		}
+
+		if (length > 0) {
+			if (output) {
+				output[result] = length;
+				output[result + 1] = data[i - 1];
+			}
+			result += 2;
+		}
+
+		length = 1;
+	}
+
+	return result;
+}
+
+/* decodes the bytes from skip to skip + size of a run-length encoded row */
+static void
+decode_runs(const uint8_t *runs, const uint8_t *end, size_t skip,
+    uint8_t *output, size_t size) {
+	size_t length;
+
+	for (; runs < end && size > 0; runs += 2) {
+		if (runs[0] <= skip) {
+			skip -= runs[0];
+			continue;
+		}
+
+		length = runs[0] - skip;
+		if (length > size) length = size;
+		memset(output, runs[1], length);
+		output += length;
+		size -= length;
+		skip = 0;
+	}
+}
+
+static bool
+save_frame_buffer(GContext *ctx) {
+	GBitmap *frame_buffer = graphics_capture_frame_buffer(ctx);
+	GRect bounds;
+	uint8_t *runs, *start;
+	size_t offset, row_size, size;
+	int16_t y;
+
+	COUNT_EVENT(COUNT_CACHE_SAVES);
+
+	if (!frame_buffer) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unable to capture frame buffer for saving");
+		return false;
+	}
+
+	if (gbitmap_get_data_size(frame_buffer) != SCREEN_BUFFER_SIZE) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unexpected frame buffer size %u, expected %u",
+		    gbitmap_get_data_size(frame_buffer), SCREEN_BUFFER_SIZE);
 		graphics_release_frame_buffer(ctx, frame_buffer);
 		return false;
 	}
 
-	memcpy(gbitmap_get_data(frame_buffer), background_cache,
-	    sizeof background_cache);
+	bounds = gbitmap_get_bounds(frame_buffer);
+	size = (bounds.size.h + 1) * sizeof *background_cache;
+	for (y = 0; y < bounds.size.h; y += 1) {
+		row_size = frame_buffer_span(frame_buffer, y,
+		    0, bounds.size.w - 1, &start);
+		size += encode_runs(start, row_size, 0);
+	}
+
+	free_background_cache();
+	background_cache = malloc(size);
+
+	if (!background_cache) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unable to allocate %u bytes for background cache",
+		    (unsigned)size);
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		return false;
+	}
+
+	runs = (uint8_t *)(background_cache + bounds.size.h + 1);
+	offset = 0;
+	for (y = 0; y < bounds.size.h; y += 1) {
+		row_size = frame_buffer_span(frame_buffer, y,
+		    0, bounds.size.w - 1, &start);
+		background_cache[y] = offset;
+		offset += encode_runs(start, row_size, runs + offset);
+	}
+	background_cache[bounds.size.h] = offset;
+
+	use_background_cache = true;
+	graphics_release_frame_buffer(ctx, frame_buffer);
+	return true;
+}
+
+static bool
+restore_frame_buffer(GContext *ctx, GRect region) {
+	GBitmap *frame_buffer;
+	GRect bounds;
+	uint8_t *row_start, *runs, *start;
+	int16_t x1, y, y1;
+	size_t size;
+
+	if (!background_cache) return false;
+
+	frame_buffer = graphics_capture_frame_buffer(ctx);
+
+	if (!frame_buffer) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unable to capture frame buffer for restore");
+		return false;
+	}
+
+	if (gbitmap_get_data_size(frame_buffer) != SCREEN_BUFFER_SIZE) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unexpected frame buffer size %u, expected %u",
+		    gbitmap_get_data_size(frame_buffer), SCREEN_BUFFER_SIZE);
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		return false;
+	}
+
+	bounds = gbitmap_get_bounds(frame_buffer);
+	runs = (uint8_t *)(background_cache + bounds.size.h + 1);
+	x1 = region.origin.x + region.size.w - 1;
+	y1 = region.origin.y + region.size.h;
+	if (x1 >= bounds.size.w) x1 = bounds.size.w - 1;
+	if (y1 > bounds.size.h) y1 = bounds.size.h;
+
+	for (y = (region.origin.y > 0) ? region.origin.y : 0; y < y1; y += 1) {
+		size = frame_buffer_span(frame_buffer, y,
+		    (region.origin.x > 0) ? region.origin.x : 0, x1, &start);
+		if (!size) continue;
+		frame_buffer_span(frame_buffer, y, 0, bounds.size.w - 1,
+		    &row_start);
+		decode_runs(runs + background_cache[y],
+		    runs + background_cache[y + 1],
+		    start - row_start, start, size);
+	}
+
 	graphics_release_frame_buffer(ctx, frame_buffer);
 	return true;
 }
+
+/*
+ * Repaints only the area changed since the last frame, the window itself
+ * being transparent. Returns false when the marks, icons and text have to
+ * be redrawn, in which case the whole layer has been cleared.
+ */
+static bool
+restore_background(GContext *ctx, GRect bounds) {
+	GRect region = dirty_rect;
+
+	dirty_rect = GRectZero;
+
+	if (use_background_cache && restore_frame_buffer(ctx, region)) {
+		COUNT_EVENT(COUNT_CACHE_HITS);
+		return true;
+	}
+
+	COUNT_EVENT(COUNT_CACHE_MISSES);
+	graphics_context_set_fill_color(ctx, background_color);
+	graphics_fill_rect(ctx, bounds, 0, GCornerNone);
+	return false;
+}
+
+/*
+ * The marks alone, run-length encoded like the cache rows but without the
+ * row offsets, are persisted in chunks from MARKS_FIRST_KEY, behind a
+ * header holding their hash and size. The first frame after a launch
+ * decodes them instead of rasterizing the marks again.
+ */
+#define MARKS_HEADER_KEY 3
+#define MARKS_FIRST_KEY 16
+#define MARKS_MAX_CHUNKS 12
+#define MARKS_FORMAT_VERSION 1
+
+static uint32_t stored_marks_hash = 0;
+static uint32_t stored_marks_size = 0;
+static bool warm_start = false;
+
+/* FNV-1a of the mark colors and of the platform frame buffer layout */
+static uint32_t
+marks_hash(void) {
+	const uint32_t words[] = {
+		COLOR_KEY(background_color),
+		COLOR_KEY(minute_mark_color),
+		COLOR_KEY(hour_mark_color),
+		COLOR_KEY(inner_rectangle_color),
+		SCREEN_BUFFER_SIZE,
+		PBL_IF_RECT_ELSE(0, 1),
+		MARKS_FORMAT_VERSION,
+	};
+	const uint8_t *data = (const uint8_t *)words;
+	uint32_t result = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < sizeof words; i += 1)
+		result = (result ^ data[i]) * 16777619u;
+
+	return result ? result : 1;
+}
+
+static void
+read_stored_marks_header(void) {
+	uint32_t header[2];
+
+	if (persist_read_data(MARKS_HEADER_KEY, header, sizeof header)
+	    != (int)sizeof header
+	    || header[1] > MARKS_MAX_CHUNKS * PERSIST_DATA_MAX_LENGTH) {
+		stored_marks_hash = stored_marks_size = 0;
+		return;
+	}
+
+	stored_marks_hash = header[0];
+	stored_marks_size = header[1];
+}
+
+/* moves *output to the next row holding bytes, returns its size or 0 */
+static size_t
+next_marks_row(GBitmap *frame_buffer, int16_t *y, uint8_t **output) {
+	const GRect bounds = gbitmap_get_bounds(frame_buffer);
+	size_t size = 0;
+
+	while (!size && ++*y < bounds.size.h)
+		size = frame_buffer_span(frame_buffer, *y,
+		    0, bounds.size.w - 1, output);
+
+	return size;
+}
+
+static bool
+restore_stored_marks(GContext *ctx) {
+	uint8_t chunk[PERSIST_DATA_MAX_LENGTH];
+	GBitmap *frame_buffer;
+	uint8_t *output = 0;
+	size_t i, row_size, remaining, size;
+	uint32_t key = MARKS_FIRST_KEY;
+	int16_t y = -1;
+	bool result = true;
+
+	if (!stored_marks_size || stored_marks_hash != marks_hash())
+		return false;
+
+	frame_buffer = graphics_capture_frame_buffer(ctx);
+	if (!frame_buffer) return false;
+
+	if (gbitmap_get_data_size(frame_buffer) != SCREEN_BUFFER_SIZE) {
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		return false;
+	}
+
+	row_size = next_marks_row(frame_buffer, &y, &output);
+	for (remaining = stored_marks_size; result && remaining > 0;
+	    remaining -= size, key += 1) {
+		size = (remaining < sizeof chunk) ? remaining : sizeof chunk;
+		if (persist_read_data(key, chunk, size) != (int)size) {
+			result = false;
+			break;
+		}
+
+		for (i = 0; i + 1 < size; i += 2) {
+			if (chunk[i] > row_size) {
+				result = false;
+				break;
+			}
+			memset(output, chunk[i + 1], chunk[i]);
+			output += chunk[i];
+			row_size -= chunk[i];
+			if (!row_size) row_size = next_marks_row(frame_buffer,
+			    &y, &output);
+		}
+	}
+
+	graphics_release_frame_buffer(ctx, frame_buffer);
+
+	if (!result || row_size) {
+		APP_LOG(APP_LOG_LEVEL_WARNING, "invalid stored marks");
+		stored_marks_size = 0;
+		return false;
+	}
+
+	return true;
+}
+
+/* deletes the header first, so that chunks are never mismatched */
+static void
+store_marks(GContext *ctx) {
+	GBitmap *frame_buffer = graphics_capture_frame_buffer(ctx);
+	GRect bounds;
+	uint32_t header[2];
+	uint8_t *runs, *start;
+	size_t chunk, offset, row_size, size;
+	int16_t y;
+
+	stored_marks_hash = marks_hash();
+	stored_marks_size = 0;
+
+	if (!frame_buffer) return;
+
+	if (gbitmap_get_data_size(frame_buffer) != SCREEN_BUFFER_SIZE) {
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		return;
+	}
+
+	bounds = gbitmap_get_bounds(frame_buffer);
+	size = 0;
+	for (y = 0; y < bounds.size.h; y += 1) {
+		row_size = frame_buffer_span(frame_buffer, y,
+		    0, bounds.size.w - 1, &start);
+		size += encode_runs(start, row_size, 0);
+	}
+
+	runs = (size <= MARKS_MAX_CHUNKS * PERSIST_DATA_MAX_LENGTH)
+	    ? malloc(size) : 0;
+
+	if (!runs) {
+		APP_LOG(APP_LOG_LEVEL_INFO,
+		    "not storing %u bytes of marks", (unsigned)size);
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		return;
+	}
+
+	offset = 0;
+	for (y = 0; y < bounds.size.h; y += 1) {
+		row_size = frame_buffer_span(frame_buffer, y,
+		    0, bounds.size.w - 1, &start);
+		offset += encode_runs(start, row_size, runs + offset);
+	}
+	graphics_release_frame_buffer(ctx, frame_buffer);
+
+	persist_delete(MARKS_HEADER_KEY);
+	for (offset = 0; offset < size; offset += PERSIST_DATA_MAX_LENGTH) {
+		chunk = size - offset;
+		if (chunk > PERSIST_DATA_MAX_LENGTH)
+			chunk = PERSIST_DATA_MAX_LENGTH;
+		if (persist_write_data(MARKS_FIRST_KEY
+		    + offset / PERSIST_DATA_MAX_LENGTH,
+		    runs + offset, chunk) != (int)chunk) {
+			APP_LOG(APP_LOG_LEVEL_ERROR,
+			    "error while storing marks");
+			free(runs);
+			return;
+		}
+	}
+	free(runs);
+
+	header[0] = stored_marks_hash;
+	header[1] = size;
+	if (persist_write_data(MARKS_HEADER_KEY, header, sizeof header)
+	    == (int)sizeof header)
+		stored_marks_size = size;
+}
+
+#endif
+
+/* static elements are baked into the background cache */
+static void
+mark_background_dirty(GRect frame) {
+#ifdef CACHE_BACKGROUND
+	free_background_cache();
+	use_background_cache = false;
+	frame = layer_get_frame(background_layer);
+#endif
+	mark_dirty(frame);
+}
+
+/* stores a new element key, returns whether it differs from the old one */
+static bool
+update_key(uint32_t *key, uint32_t new_key) {
+	if (*key == new_key) return false;
+	*key = new_key;
+	return true;
+}
+
+/*
+ * Resolves which overlays are drawn and invalidates only the elements
+ * whose rendering inputs changed, after any state or config change.
+ * Hand rotation is keyed separately by the memoized vertices, and the
+ * reduced rendering only keeps the marks and the hands.
+ */
+static void
+update_elements(void) {
+	bluetooth_icon_shown = !bluetooth_connected
+	    && IS_VISIBLE(bluetooth_color);
+	battery_icon_shown = !has_battery
+	    && (IS_VISIBLE(battery_color) || IS_VISIBLE(battery_color2));
+	icon_hidden = reduced_rendering
+	    || (!bluetooth_icon_shown && !battery_icon_shown);
+	text_hidden = reduced_rendering
+	    || !text_format[0] || !IS_VISIBLE(text_color);
+
+#ifndef SINGLE_LAYER
+	layer_set_hidden(icon_layer, icon_hidden);
+	layer_set_hidden(text_layer, text_hidden);
+#endif
+
+	if (update_key(&marks_key, COLOR_KEY(background_color)
+	    | COLOR_KEY(minute_mark_color) << 8
+	    | COLOR_KEY(hour_mark_color) << 16
+	    | COLOR_KEY(inner_rectangle_color) << 24))
+		mark_background_dirty(layer_get_frame(background_layer));
+
+	if (update_key(&icon_key, icon_hidden ? 0
+	    : bluetooth_icon_shown
+	    | battery_icon_shown << 1
+	    | bluetooth_connected << 2
+	    | (battery_icon_shown ? current_battery / 5 : 0) << 3
+	    | (bluetooth_icon_shown ? COLOR_KEY(bluetooth_color) : 0) << 8
+	    | (battery_icon_shown ? COLOR_KEY(battery_color) : 0) << 16
+	    | (battery_icon_shown ? COLOR_KEY(battery_color2) : 0) << 24))
+		mark_background_dirty(icon_frame);
+
+	if (update_key(&text_key, text_hidden ? 0
+	    : 1 | text_font << 1 | COLOR_KEY(text_color) << 8))
+		mark_background_dirty(text_frame);
+
+	if (update_key(&hands_key, COLOR_KEY(hour_hand_color)
+	    | COLOR_KEY(minute_hand_color) << 8
+	    | COLOR_KEY(background_color) << 16)) {
+		mark_dirty(minute_hand_box);
+		mark_dirty(hour_hand_box);
+	}
+
+	if (update_key(&pin_key, COLOR_KEY(pin_color)
+	    | COLOR_KEY(background_color) << 8)) {
+		mark_dirty(PIN_FRAME);
+		mark_dirty(seconds_hand_box);
+	}
+}
+
+static void
+draw_marks(GContext *ctx, GRect bounds) {
+	GBitmap *frame_buffer;
+	uint32_t start = clock_ms();
+	int i;
+#ifdef PBL_RECT
+	GRect rect;
+#endif
+
+	COUNT_EVENT(COUNT_MARKS_DRAWS);
+	frame_buffer = graphics_capture_frame_buffer(ctx);
+
+	if (!frame_buffer) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unable to capture frame buffer for marks");
+		return;
+	}
+
+	if (gbitmap_get_data_size(frame_buffer) != SCREEN_BUFFER_SIZE) {
+		APP_LOG(APP_LOG_LEVEL_WARNING,
+		    "Unexpected frame buffer size %u, expected %u",
+		    gbitmap_get_data_size(frame_buffer), SCREEN_BUFFER_SIZE);
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		return;
+	}
+
+	if (IS_VISIBLE(minute_mark_color)) {
+		for (i = 0; i < 60; i += 1)
+			frame_buffer_line(frame_buffer, minute_marks[i],
+			    false, minute_mark_color);
+	}
+
+	if (IS_VISIBLE(hour_mark_color)) {
+		for (i = 0; i < 12; i += 1)
+			frame_buffer_line(frame_buffer, hour_marks[i],
+			    true, hour_mark_color);
+	}
+
+	if (IS_VISIBLE(inner_rectangle_color)) {
+#ifdef PBL_ROUND
+		frame_buffer_circle(frame_buffer, grect_center_point(&bounds),
+		    (bounds.size.w + bounds.size.h) / 4 - 35,
+		    inner_rectangle_color);
+#else
+		INSET_RECT(rect, bounds, 35);
+#ifdef PBL_BW
+		for (i = rect.origin.x +2; i < rect.origin.x + rect.size.w; i += 3) {
+			frame_buffer_pixel(frame_buffer, i, rect.origin.y,
+			    inner_rectangle_color);
+			frame_buffer_pixel(frame_buffer,
+			    i, rect.origin.y + rect.size.h - 1,
+			    inner_rectangle_color);
+		}
+
+		for (i = rect.origin.y +2;
+		    i < rect.origin.y + rect.size.h;
+		    i += 3) {
+			frame_buffer_pixel(frame_buffer, rect.origin.x, i,
+			    inner_rectangle_color);
+			frame_buffer_pixel(frame_buffer,
+			    rect.origin.x + rect.size.w - 1, i,
+			    inner_rectangle_color);
+		}
+#else
+		frame_buffer_fill_span(frame_buffer, rect.origin.y,
+		    rect.origin.x, rect.origin.x + rect.size.w - 1,
+		    inner_rectangle_color);
+		frame_buffer_fill_span(frame_buffer,
+		    rect.origin.y + rect.size.h - 1,
+		    rect.origin.x, rect.origin.x + rect.size.w - 1,
+		    inner_rectangle_color);
+		for (i = rect.origin.y + 1;
+		    i < rect.origin.y + rect.size.h - 1;
+		    i += 1) {
+			frame_buffer_pixel(frame_buffer, rect.origin.x, i,
+			    inner_rectangle_color);
+			frame_buffer_pixel(frame_buffer,
+			    rect.origin.x + rect.size.w - 1, i,
+			    inner_rectangle_color);
+		}
+#endif
+#endif
+	}
+
+	graphics_release_frame_buffer(ctx, frame_buffer);
+	record_timing(TIME_MARKS, start);
+}
+
+#ifdef CACHE_BACKGROUND
+/*
+ * Marks on a freshly cleared frame, from the stored copy right after a
+ * launch. A stale copy is only replaced at launch, so that switching
+ * presets back and forth does not rewrite it each time.
+ */
+static void
+draw_background_marks(GContext *ctx, GRect bounds) {
+	bool launching = warm_start;
+
+	warm_start = false;
+	if (launching && restore_stored_marks(ctx)) return;
+	if (launching) {
+		graphics_context_set_fill_color(ctx, background_color);
+		graphics_fill_rect(ctx, bounds, 0, GCornerNone);
+	}
+
+	draw_marks(ctx, bounds);
+	if (launching && (!stored_marks_size
+	    || stored_marks_hash != marks_hash()))
+		store_marks(ctx);
+}
+#endif
+
+/* unit vector of a hand position, from the quarter-wave table */
+static void
+hand_unit_vector(unsigned position, int32_t *sin_value, int32_t *cos_value) {
+	const unsigned quarter = HAND_POSITIONS / 4;
+	const unsigned i = position % quarter;
+
+	switch (position / quarter % 4) {
+	    case 0:
+		*sin_value = hand_unit[i];
+		*cos_value = hand_unit[quarter - i];
+		break;
+	    case 1:
+		*sin_value = hand_unit[quarter - i];
+		*cos_value = -(int32_t)hand_unit[i];
+		break;
+	    case 2:
+		*sin_value = -(int32_t)hand_unit[i];
+		*cos_value = -(int32_t)hand_unit[quarter - i];
+		break;
+	    default:
+		*sin_value = -(int32_t)hand_unit[quarter - i];
+		*cos_value = hand_unit[i];
+		break;
+	}
+}
+
+/* integer vertices of a hand rotated around the center, rounded */
+static void
+rotate_hand(const GPathInfo *info, unsigned position, GPoint *output) {
+	const int32_t half = 1 << (HAND_UNIT_SHIFT - 1);
+	int32_t sin_value, cos_value;
+	uint32_t i;
+
+	hand_unit_vector(position, &sin_value, &cos_value);
+
+	for (i = 0; i < info->num_points; i += 1) {
+		output[i].x = (info->points[i].x * cos_value
+		    - info->points[i].y * sin_value + half) >> HAND_UNIT_SHIFT;
+		output[i].y = (info->points[i].x * sin_value
+		    + info->points[i].y * cos_value + half) >> HAND_UNIT_SHIFT;
+	}
+}
+
+/* screen area covered by rotated hand vertices, outline and rounding */
+static GRect
+hand_box(const GPoint *points, uint32_t num_points) {
+	int16_t x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	uint32_t i;
+
+	for (i = 0; i < num_points; i += 1) {
+		if (points[i].x < x0) x0 = points[i].x;
+		if (points[i].x > x1) x1 = points[i].x;
+		if (points[i].y < y0) y0 = points[i].y;
+		if (points[i].y > y1) y1 = points[i].y;
+	}
+
+	return GRect(center.x + x0 - 2, center.y + y0 - 2,
+	    x1 - x0 + 5, y1 - y0 + 5);
+}
+
+/*
+ * Invalidates the union of the previous and new areas of a hand, only
+ * when its rotated vertices actually change. Returns that union.
+ */
+static GRect
+update_hand(const GPathInfo *info, unsigned position, GPoint *points,
+    GRect *box, bool force) {
+	GPoint new_points[4] = { { 0, 0 } };
+	GRect new_box, area;
+
+	rotate_hand(info, position, new_points);
+	if (!force && !memcmp(new_points, points, sizeof new_points))
+		return GRectZero;
+
+	new_box = hand_box(new_points, info->num_points);
+	area = grect_union(*box, new_box);
+	memcpy(points, new_points, sizeof new_points);
+	*box = new_box;
+	mark_dirty(area);
+	return area;
+}
+
+/* the rotated vertices are memoized here, paths draw them unrotated */
+static void
+update_hands(bool force) {
+	GRect area;
+
+	area = update_hand(&minute_hand_path_points,
+	    tm_now.tm_min * (HAND_POSITIONS / 60),
+	    minute_hand_points, &minute_hand_box, force);
+#ifndef SINGLE_LAYER
+	if (area.size.w) layer_set_frame(minute_hand_layer, area);
+#endif
+
+	area = update_hand(&hour_hand_path_points,
+	    (tm_now.tm_hour % 12) * (HAND_POSITIONS / 12)
+	    + tm_now.tm_min * (HAND_POSITIONS / 720),
+	    hour_hand_points, &hour_hand_box, force);
+#ifndef SINGLE_LAYER
+	if (area.size.w) layer_set_frame(hour_hand_layer, area);
+#endif
+	(void)area;
+}
+
+/* the seconds hand is a plain segment, invalidated on each of its moves */
+static void
+update_seconds_hand(void) {
+	GPoint points[2];
+	GRect new_box, area;
+
+	if (!seconds_hand_shown) return;
+
+	rotate_hand(&seconds_hand_path_points,
+	    tm_now.tm_sec * (HAND_POSITIONS / 60), points);
+	seconds_hand_segment[0] = center.x + points[0].x;
+	seconds_hand_segment[1] = center.y + points[0].y;
+	seconds_hand_segment[2] = center.x + points[1].x;
+	seconds_hand_segment[3] = center.y + points[1].y;
+
+	new_box = hand_box(points, 2);
+	area = grect_union(seconds_hand_box, new_box);
+	seconds_hand_box = new_box;
+	mark_dirty(area);
+#ifndef SINGLE_LAYER
+	layer_set_frame(seconds_hand_layer, area);
+#endif
+}
+
+/*
+ * Rasterizes directly into the frame buffer, with a transient GPath only
+ * as fallback, origin being the screen position of the drawing context.
+ */
+static void
+draw_hand(GContext *ctx, GPoint origin, const GPathInfo *path_info,
+    const GPoint *points, GColor color) {
+	uint32_t start = clock_ms();
+	GBitmap *frame_buffer = graphics_capture_frame_buffer(ctx);
+	GPath *path;
+
+	COUNT_EVENT(COUNT_HANDS_DRAWS);
+	if (frame_buffer
+	    && gbitmap_get_data_size(frame_buffer) == SCREEN_BUFFER_SIZE) {
+		draw_hand_spans(frame_buffer, points, color, background_color);
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		record_timing(TIME_HANDS, start);
+		return;
+	}
+
+	if (frame_buffer) graphics_release_frame_buffer(ctx, frame_buffer);
+
+	path = gpath_create(path_info);
+	if (path) {
+		graphics_context_set_fill_color(ctx, color);
+		graphics_context_set_stroke_color(ctx, background_color);
+		gpath_move_to(path,
+		    GPoint(center.x - origin.x, center.y - origin.y));
+		gpath_draw_filled(ctx, path);
+		gpath_draw_outline(ctx, path);
+		gpath_destroy(path);
+	}
+	record_timing(TIME_HANDS, start);
+}
+
+static void
+draw_seconds_hand(GContext *ctx, GPoint origin) {
+	GBitmap *frame_buffer = graphics_capture_frame_buffer(ctx);
+
+	COUNT_EVENT(COUNT_SECONDS_DRAWS);
+	if (frame_buffer
+	    && gbitmap_get_data_size(frame_buffer) == SCREEN_BUFFER_SIZE) {
+		frame_buffer_line(frame_buffer, seconds_hand_segment,
+		    false, pin_color);
+		graphics_release_frame_buffer(ctx, frame_buffer);
+		return;
+	}
+
+	if (frame_buffer) graphics_release_frame_buffer(ctx, frame_buffer);
+
+	graphics_context_set_stroke_color(ctx, pin_color);
+	graphics_draw_line(ctx,
+	    GPoint(seconds_hand_segment[0] - origin.x,
+	    seconds_hand_segment[1] - origin.y),
+	    GPoint(seconds_hand_segment[2] - origin.x,
+	    seconds_hand_segment[3] - origin.y));
+}
+
+static void
+draw_pin(GContext *ctx, GPoint pin) {
+	COUNT_EVENT(COUNT_PIN_DRAWS);
+	graphics_context_set_fill_color(ctx, background_color);
+	graphics_fill_circle(ctx, pin, 2);
+	graphics_context_set_fill_color(ctx, pin_color);
+	graphics_fill_circle(ctx, pin, 1);
+}
+
+/*
+ * Status icons are rasterized once per color configuration into small
+ * opaque bitmaps over the background color, which always lies under
+ * them, so that each frame only blits them.
+ */
+#define BLUETOOTH_ICON_SIZE GSize(27, 24)
+#define BLUETOOTH_ICON_ORIGIN GPoint(13, 14)
+#define BATTERY_ICON_SIZE GSize(24, 7)
+
+/* allocates the bitmap if needed, and fills it with the background */
+static GBitmap *
+clear_icon_bitmap(GBitmap *bitmap, GSize size) {
+	int16_t y;
+
+	if (!bitmap) {
+#ifdef PBL_SDK_3
+		bitmap = gbitmap_create_blank(size,
+		    PBL_IF_COLOR_ELSE(GBitmapFormat8Bit, GBitmapFormat1Bit));
+#else
+		bitmap = gbitmap_create_blank(size);
+#endif
+		if (!bitmap) return 0;
+	}
+
+	for (y = 0; y < size.h; y += 1)
+		frame_buffer_fill_span(bitmap, y, 0, size.w - 1,
+		    background_color);
+	return bitmap;
+}
+
+static void
+fill_icon_rect(GBitmap *bitmap, GRect rect, GColor color) {
+	int16_t y;
+
+	if (!IS_VISIBLE(color)) return;
+	for (y = rect.origin.y; y < rect.origin.y + rect.size.h; y += 1)
+		frame_buffer_fill_span(bitmap, y, rect.origin.x,
+		    rect.origin.x + rect.size.w - 1, color);
+}
+
+/* open polyline, points being relative to origin */
+static void
+draw_icon_lines(GBitmap *bitmap, GPoint origin, const GPoint *points,
+    unsigned count, GColor color) {
+	uint8_t segment[4];
+	unsigned i;
+
+	for (i = 0; i + 1 < count; i += 1) {
+		segment[0] = origin.x + points[i].x;
+		segment[1] = origin.y + points[i].y;
+		segment[2] = origin.x + points[i + 1].x;
+		segment[3] = origin.y + points[i + 1].y;
+		frame_buffer_line(bitmap, segment, false, color);
+	}
+}
+
+static GBitmap *
+get_bluetooth_icon(void) {
+	if (!update_key(&bluetooth_icon_key, COLOR_KEY(bluetooth_color)
+	    | COLOR_KEY(background_color) << 8) && bluetooth_icon)
+		return bluetooth_icon;
+
+	bluetooth_icon = clear_icon_bitmap(bluetooth_icon,
+	    BLUETOOTH_ICON_SIZE);
+	if (!bluetooth_icon) return 0;
+
+	draw_icon_lines(bluetooth_icon, BLUETOOTH_ICON_ORIGIN,
+	    bluetooth_frame_points, 4, bluetooth_color);
+	draw_icon_lines(bluetooth_icon, BLUETOOTH_ICON_ORIGIN,
+	    bluetooth_logo_points, 7, bluetooth_color);
+	return bluetooth_icon;
+}
+
+/* full battery, the charge level being applied when blitting */
+static GBitmap *
+get_battery_icon(void) {
+	if (!update_key(&battery_icon_key, COLOR_KEY(battery_color)
+	    | COLOR_KEY(battery_color2) << 8
+	    | COLOR_KEY(background_color) << 16) && battery_icon)
+		return battery_icon;
+
+	battery_icon = clear_icon_bitmap(battery_icon, BATTERY_ICON_SIZE);
+	if (!battery_icon) return 0;
+
+	fill_icon_rect(battery_icon, GRect(0, 0, 22, 7), battery_color);
+	fill_icon_rect(battery_icon, GRect(22, 2, 2, 3), battery_color);
+	if (!IS_EQUAL(battery_color2, battery_color)) {
+		fill_icon_rect(battery_icon, GRect(5, 1, 4, 5),
+		    battery_color2);
+		fill_icon_rect(battery_icon, GRect(13, 1, 4, 5),
+		    battery_color2);
+	}
+	return battery_icon;
+}
+
+static void
+free_icon_bitmaps(void) {
+	if (bluetooth_icon) gbitmap_destroy(bluetooth_icon);
+	if (battery_icon) gbitmap_destroy(battery_icon);
+	bluetooth_icon = battery_icon = 0;
+}
+
+static void
+draw_icons(GContext *ctx, GRect frame) {
+	GPoint center = grect_center_point(&frame);
+	uint32_t start = clock_ms();
+	GBitmap *bitmap;
+	GPoint pt;
+
+	COUNT_EVENT(COUNT_ICONS_DRAWS);
+	if (bluetooth_icon_shown && (bitmap = get_bluetooth_icon())) {
+		pt.x = center.x;
+		pt.y = center.y + (has_battery ? +1 : -2);
+		graphics_draw_bitmap_in_rect(ctx, bitmap,
+		    GRect(pt.x - BLUETOOTH_ICON_ORIGIN.x,
+		    pt.y - BLUETOOTH_ICON_ORIGIN.y,
+		    BLUETOOTH_ICON_SIZE.w, BLUETOOTH_ICON_SIZE.h));
+	}
+
+	if (battery_icon_shown && (bitmap = get_battery_icon())) {
+		pt.x = center.x - 11;
+		pt.y = center.y
+		    + (bluetooth_connected ? 0 : PBL_IF_RECT_ELSE(9, 11));
+		graphics_draw_bitmap_in_rect(ctx, bitmap,
+		    GRect(pt.x, pt.y,
+		    BATTERY_ICON_SIZE.w, BATTERY_ICON_SIZE.h));
+		graphics_context_set_fill_color(ctx, background_color);
+		if (current_battery < 100)
+			graphics_fill_rect(ctx,
+			    GRect(pt.x + 1 + current_battery / 5, pt.y + 1,
+			    20 - current_battery / 5, 5),
+			    0, GCornerNone);
+	}
+
+	record_timing(TIME_ICONS, start);
+}
+
+static void
+draw_text(GContext *ctx, GRect frame) {
+	uint32_t start = clock_ms();
+
+	COUNT_EVENT(COUNT_TEXT_DRAWS);
+	graphics_context_set_text_color(ctx, text_color);
+	graphics_draw_text(ctx, text_buffer, text_layer_font,
+	    frame, GTextOverflowModeWordWrap, GTextAlignmentCenter, 0);
+	record_timing(TIME_TEXT, start);
+}
+
+#ifdef SINGLE_LAYER
+/*
+ * Compositor drawing every element in stacking order from the only layer,
+ * skipping the ones outside the area changed since the last frame.
+ */
+static void
+draw_background(Layer *layer, GContext *ctx) {
+	GRect bounds = layer_get_bounds(layer);
+	GRect region = bounds;
+
+#ifdef CACHE_BACKGROUND
+	region = dirty_rect;
+	if (!restore_background(ctx, bounds)) {
+		region = bounds;
+		draw_background_marks(ctx, bounds);
+		if (!icon_hidden) draw_icons(ctx, icon_frame);
+		if (!text_hidden) draw_text(ctx, text_frame);
+		save_frame_buffer(ctx);
+	}
+#else
+	if (!BACKGROUND_IS_PLAIN) draw_marks(ctx, bounds);
+	if (!icon_hidden) draw_icons(ctx, icon_frame);
+	if (!text_hidden) draw_text(ctx, text_frame);
+#endif
+
+	if (grect_overlaps(region, minute_hand_box))
+		draw_hand(ctx, GPointZero, &minute_hand_rotated,
+		    minute_hand_points, hour_hand_color);
+	if (grect_overlaps(region, hour_hand_box))
+		draw_hand(ctx, GPointZero, &hour_hand_rotated,
+		    hour_hand_points, minute_hand_color);
+	if (seconds_hand_shown && grect_overlaps(region, seconds_hand_box))
+		draw_seconds_hand(ctx, GPointZero);
+
+#ifdef CACHE_BACKGROUND
+	if (!use_background_cache) return;
+#endif
+	if (grect_overlaps(region, PIN_FRAME)) draw_pin(ctx, center);
+}
+#else
+static void
+draw_background(Layer *layer, GContext *ctx) {
+	GRect bounds = layer_get_bounds(layer);
+
+#ifdef CACHE_BACKGROUND
+	if (!restore_background(ctx, bounds))
+		draw_background_marks(ctx, bounds);
+#else
+	draw_marks(ctx, bounds);
 #endif
+}
 
-#ifdef PBL_RECT
 static void
-point_at_angle(GRect *rect, int32_t angle, GPoint *output, int *horizontal) {
-	int32_t sin_value = sin_lookup(angle);
-	int32_t cos_value = cos_lookup(angle);
-	int32_t abs_sin = abs(sin_value);
-	int32_t abs_cos = abs(cos_value);
-	int32_t width = rect->size.w - 1;
-	int32_t height = rect->size.h - 1;
+minute_hand_layer_draw(Layer *layer, GContext *ctx) {
+	draw_hand(ctx, layer_get_frame(layer).origin, &minute_hand_rotated,
+	    minute_hand_points, hour_hand_color);
+}
 
-	*horizontal = (height * abs_sin < width * abs_cos);
+static void
+hour_hand_layer_draw(Layer *layer, GContext *ctx) {
+	draw_hand(ctx, layer_get_frame(layer).origin, &hour_hand_rotated,
+	    hour_hand_points, minute_hand_color);
+}
 
-	if (*horizontal) {
-		output->x = (height * sin_value / abs_cos + width) / 2;
-		output->y = (cos_value > 0) ? 0 : height;
-	}
-	else {
-		output->x = (sin_value > 0) ? width : 0;
-		output->y = (height - width * cos_value / abs_sin) / 2;
-	}
-	output->x += rect->origin.x;
-	output->y += rect->origin.y;
+static void
+seconds_hand_layer_draw(Layer *layer, GContext *ctx) {
+	draw_seconds_hand(ctx, layer_get_frame(layer).origin);
 }
 
 static void
-background_layer_draw(Layer *layer, GContext *ctx) {
-	int horiz, i;
+pin_layer_draw(Layer *layer, GContext *ctx) {
 	GRect bounds = layer_get_bounds(layer);
-	GRect rect, rect2;
-	GPoint pt1, pt2;
-
-	(void)layer;
 
 #ifdef CACHE_BACKGROUND
-	if (use_background_cache && restore_frame_buffer(ctx)) return;
+	if (!use_background_cache) return;
 #endif
 
-	if (IS_VISIBLE(minute_mark_color)) {
-		graphics_context_set_stroke_color(ctx, minute_mark_color);
-		INSET_RECT(rect, bounds, 5);
-		for (i = 0; i < 60; i += 1) {
-			point_at_angle(&rect, TRIG_MAX_ANGLE * i / 60,
-			    &pt1, &horiz);
-			pt2.x = pt1.x + horiz;
-			pt2.y = pt1.y + (1 - horiz);
-			graphics_draw_line(ctx, pt1, pt2);
-		}
-	}
+	draw_pin(ctx, grect_center_point(&bounds));
+}
 
-	if (IS_VISIBLE(hour_mark_color)) {
-#ifndef PBL_BW
-		graphics_context_set_stroke_width(ctx, 3);
+static void
+icon_layer_draw(Layer *layer, GContext *ctx) {
+#ifdef CACHE_BACKGROUND
+	if (use_background_cache) return;
 #endif
 
-		graphics_context_set_stroke_color(ctx, hour_mark_color);
-		INSET_RECT(rect,  bounds, 11);
-		INSET_RECT(rect2, bounds, 22);
-		for (i = 0; i < 12; i += 1) {
-			point_at_angle(&rect, TRIG_MAX_ANGLE * i / 12,
-			    &pt1, &horiz);
-			point_at_angle(&rect2, TRIG_MAX_ANGLE * i / 12,
-			    &pt2, &horiz);
-
-			graphics_draw_line(ctx, pt1, pt2);
-
-#ifdef PBL_BW
-			pt1.x += horiz;        pt2.x += horiz;
-			pt1.y += 1 - horiz;    pt2.y += 1 - horiz;
-			graphics_draw_line(ctx, pt1, pt2);
+	draw_icons(ctx, layer_get_bounds(layer));
+}
 
-			pt1.x -= 2 * horiz;        pt2.x -= 2 * horiz;
-			pt1.y -= 2 * (1 - horiz);  pt2.y -= 2 * (1 - horiz);
-			graphics_draw_line(ctx, pt1, pt2);
+static void
+text_layer_draw(Layer *layer, GContext *ctx) {
+#ifdef CACHE_BACKGROUND
+	if (use_background_cache) return;
 #endif
-		}
 
-#ifndef PBL_BW
-		graphics_context_set_stroke_width(ctx, 1);
-#endif
-	}
+	draw_text(ctx, layer_get_bounds(layer));
+}
 
-	if (IS_VISIBLE(inner_rectangle_color)) {
-		INSET_RECT(rect, bounds, 35);
-		graphics_context_set_stroke_color(ctx, inner_rectangle_color);
-#ifdef PBL_BW
-		pt1.y = rect.origin.y;
-		pt2.y = rect.origin.y + rect.size.h - 1;
-		for (i = rect.origin.x +2; i < rect.origin.x + rect.size.w; i += 3) {
-			pt1.x = pt2.x = i;
-			graphics_draw_pixel(ctx, pt1);
-			graphics_draw_pixel(ctx, pt2);
-		}
+#ifdef CACHE_BACKGROUND
+/* snapshot of everything below the hands, taken once after a rebuild */
+static void
+cache_layer_draw(Layer *layer, GContext *ctx) {
+	(void)layer;
 
-		pt1.x = rect.origin.x;
-		pt2.x = rect.origin.x + rect.size.w - 1;
-		for (i = rect.origin.y +2;
-		    i < rect.origin.y + rect.size.h;
-		    i += 3) {
-			pt1.y = pt2.y = i;
-			graphics_draw_pixel(ctx, pt1);
-			graphics_draw_pixel(ctx, pt2);
-		}
-#else
-		graphics_draw_rect(ctx, rect);
+	if (!use_background_cache) save_frame_buffer(ctx);
+}
 #endif
-	}
-
-#ifdef CACHE_BACKGROUND
-	save_frame_buffer(ctx);
 #endif
+
+/* the whole frame in SINGLE_LAYER mode, the bottom layer otherwise */
+static void
+background_layer_draw(Layer *layer, GContext *ctx) {
+	uint32_t start = clock_ms();
+
+	COUNT_EVENT(COUNT_FRAMES);
+	draw_background(layer, ctx);
+	record_timing(TIME_BACKGROUND, start);
 }
-#else
-static GPoint
-point_at_angle(GRect bounds, int32_t angle) {
-	GPoint ret;
-	uint32_t width = bounds.size.w;
-	uint32_t height = bounds.size.h;
-	ret.x = bounds.origin.x
-	    + (TRIG_MAX_RATIO * (width + 1) + width * sin_lookup(angle))
-	    / (2 * TRIG_MAX_RATIO);
-	ret.y = bounds.origin.y
-	    + (TRIG_MAX_RATIO * (height + 1) - height * cos_lookup(angle))
-	    / (2 * TRIG_MAX_RATIO);
-	return ret;
+
+static void
+update_text_layer(struct tm *time) {
+	char new_text[sizeof text_buffer];
+
+	strftime(new_text, sizeof new_text, text_format, time);
+	if (!strcmp(new_text, text_buffer)) return;
+	memcpy(text_buffer, new_text, sizeof text_buffer);
+	mark_background_dirty(text_frame);
 }
 
 static void
-background_layer_draw(Layer *layer, GContext *ctx) {
-	const GRect bounds = layer_get_bounds(layer);
-	const GPoint center = grect_center_point(&bounds);
-	const int32_t radius = (bounds.size.w + bounds.size.h) / 4;
-	const int32_t angle_delta = TRIG_MAX_ANGLE / (6 * radius);
-	int32_t angle, x, y;
-	GRect rect;
-	GPoint pt1, pt2;
-	int i;
+update_text_font(void) {
+	Layer *window_layer = window_get_root_layer(window);
+	GRect bounds = layer_get_bounds(window_layer);
 
-	(void)layer;
+	if (text_font >= TEXT_FONT_NUMBER) text_font = 0;
 
-#ifdef CACHE_BACKGROUND
-	if (use_background_cache && restore_frame_buffer(ctx)) return;
+	text_layer_font = fonts_get_system_font(text_fonts[text_font]);
+	text_frame = GRect(bounds.origin.x,
+	    bounds.origin.y + text_offsets[text_font],
+	    bounds.size.w,
+	    text_heights[text_font]);
+
+#ifndef SINGLE_LAYER
+	if (text_layer) layer_set_frame(text_layer, text_frame);
 #endif
+}
 
-	if (IS_VISIBLE(minute_mark_color)) {
-		graphics_context_set_stroke_color(ctx, minute_mark_color);
-		INSET_RECT(rect, bounds, 5);
-		for (i = 0; i < 60; i += 1) {
-			angle = TRIG_MAX_ANGLE * i / 60;
-			graphics_draw_line(ctx,
-			    point_at_angle(rect, angle - angle_delta),
-			    point_at_angle(rect, angle + angle_delta));
-		}
-	}
+/********************
+ * REFRESH GOVERNOR *
+ ********************/
 
-	if (IS_VISIBLE(hour_mark_color)) {
-		graphics_context_set_stroke_width(ctx, 3);
-		graphics_context_set_stroke_color(ctx, hour_mark_color);
-		for (i = 0; i < 12; i += 1) {
-			angle = TRIG_MAX_ANGLE * i / 12;
-			x = sin_lookup(angle);
-			y = -cos_lookup(angle);
-			pt1.x = center.x + (radius - 11) * x / TRIG_MAX_RATIO;
-			pt1.y = center.y + (radius - 11) * y / TRIG_MAX_RATIO;
-			pt2.x = center.x + (radius - 22) * x / TRIG_MAX_RATIO;
-			pt2.y = center.y + (radius - 22) * y / TRIG_MAX_RATIO;
-			graphics_draw_line(ctx, pt1, pt2);
-		}
-	}
+/*
+ * During quiet hours or after idle_minutes without motion, the face only
+ * ticks every hour and renders the hands over the marks. Any tap, config
+ * message or motion seen at a tick restores the minute rendering, and a
+ * tap also shows the seconds hand for seconds_hand_duration seconds.
+ */
 
-	if (IS_VISIBLE(inner_rectangle_color)) {
-		graphics_context_set_stroke_width(ctx, 1);
-		graphics_context_set_stroke_color(ctx, inner_rectangle_color);
-		graphics_draw_circle(ctx, center, radius - 35);
+#define GOVERNOR_ENABLED (quiet_start_hour != quiet_end_hour || idle_minutes)
+#define MOTION_THRESHOLD 150	/* milli-g summed over the three axes */
+#define QUIET_WAKE_MINUTES 2
+
+static time_t last_activity;
+static AccelData last_accel;
+static bool has_last_accel = false;
+
+static void tick_handler(struct tm *tick_time, TimeUnits units_changed);
+static void tap_handler(AccelAxisType axis, int32_t direction);
+
+static bool
+in_quiet_hours(int hour) {
+	if (quiet_start_hour < quiet_end_hour)
+		return hour >= quiet_start_hour && hour < quiet_end_hour;
+	else if (quiet_start_hour > quiet_end_hour)
+		return hour >= quiet_start_hour || hour < quiet_end_hour;
+	else
+		return false;
+}
+
+/* compares one accelerometer reading with the previous tick's */
+static bool
+sample_motion(void) {
+	AccelData data;
+	int32_t delta;
+	bool result;
+
+	if (accel_service_peek(&data) < 0 || data.did_vibrate) return false;
+
+	delta = (data.x > last_accel.x) ? data.x - last_accel.x
+	    : last_accel.x - data.x;
+	delta += (data.y > last_accel.y) ? data.y - last_accel.y
+	    : last_accel.y - data.y;
+	delta += (data.z > last_accel.z) ? data.z - last_accel.z
+	    : last_accel.z - data.z;
+
+	result = has_last_accel && delta > MOTION_THRESHOLD;
+	last_accel = data;
+	has_last_accel = true;
+	return result;
+}
+
+static void
+update_tick_subscription(void) {
+	tick_timer_service_subscribe(seconds_hand_shown ? SECOND_UNIT
+	    : reduced_rendering ? HOUR_UNIT : MINUTE_UNIT, &tick_handler);
+}
+
+static void
+set_reduced_rendering(bool reduced) {
+	time_t now;
+
+	if (reduced == reduced_rendering) return;
+
+	reduced_rendering = reduced;
+	update_tick_subscription();
+
+	if (!reduced) {
+		now = time(0);
+		tm_now = *localtime(&now);
+		update_text_layer(&tm_now);
+		update_hands(false);
 	}
 
-#ifdef CACHE_BACKGROUND
-	save_frame_buffer(ctx);
-#endif
+	update_elements();
 }
-#endif
 
+/* called on each tick, the first one after reducing being an hour later */
 static void
-hand_layer_draw(Layer *layer, GContext *ctx) {
-	(void)layer;
+governor_tick(struct tm *tick_time) {
+	time_t now = time(0);
+	time_t idle;
 
-	graphics_context_set_fill_color(ctx, hour_hand_color);
-	graphics_context_set_stroke_color(ctx, background_color);
+	if (sample_motion()) last_activity = now;
+	idle = now - last_activity;
+
+	set_reduced_rendering(
+	    (idle_minutes && idle >= idle_minutes * 60)
+	    || (in_quiet_hours(tick_time->tm_hour)
+	     && idle >= QUIET_WAKE_MINUTES * 60));
+}
 
-	gpath_rotate_to(minute_hand_path, TRIG_MAX_ANGLE * tm_now.tm_min / 60);
-	gpath_draw_filled(ctx, minute_hand_path);
-	gpath_draw_outline(ctx, minute_hand_path);
+static void
+governor_wake(void) {
+	last_activity = time(0);
+	set_reduced_rendering(false);
+}
 
-	graphics_context_set_fill_color(ctx, minute_hand_color);
+static void
+set_seconds_hand(bool shown) {
+	time_t now;
 
-	gpath_rotate_to(hour_hand_path,
-	    TRIG_MAX_ANGLE * (tm_now.tm_hour * 60 + tm_now.tm_min) / 720);
-	gpath_draw_filled(ctx, hour_hand_path);
-	gpath_draw_outline(ctx, hour_hand_path);
+	if (shown == seconds_hand_shown) return;
 
-#ifdef CACHE_BACKGROUND
-	if (!use_background_cache) return;
+	seconds_hand_shown = shown;
+	update_tick_subscription();
+#ifndef SINGLE_LAYER
+	layer_set_hidden(seconds_hand_layer, !shown);
 #endif
 
-	graphics_context_set_fill_color(ctx, background_color);
-	graphics_fill_circle(ctx, center, 2);
-	graphics_context_set_fill_color(ctx, pin_color);
-	graphics_fill_circle(ctx, center, 1);
+	if (shown) {
+		now = time(0);
+		tm_now = *localtime(&now);
+		update_hands(false);
+		update_seconds_hand();
+	} else {
+		mark_dirty(seconds_hand_box);
+		seconds_hand_box = GRectZero;
+	}
 }
 
+/***********
+ * PRESETS *
+ ***********/
+
+/*
+ * Complete configurations in the storage format, switched on the watch
+ * by a double tap or by the quiet hours, the first preset being the day
+ * one and the second the night one.
+ */
+#define PRESET_NUMBER 3
+#define PRESET_FIRST_KEY 4
+#define CURRENT_PRESET_KEY 7
+#define DOUBLE_TAP_SECONDS 2
+
+enum preset_switching_mode {
+	PRESETS_OFF,
+	PRESETS_ON_DOUBLE_TAP,
+	PRESETS_ON_QUIET_HOURS,
+};
+
+static uint8_t current_preset = 0;
+static time_t last_tap = 0;
+static bool tap_subscribed = false;
+
+/* taps wake the app only when the configuration has a use for them */
 static void
-icon_layer_draw(Layer *layer, GContext *ctx) {
-	GRect bounds = layer_get_bounds(layer);
-	GPoint center = grect_center_point(&bounds);
-	GPoint pt;
+update_tap_subscription(void) {
+	bool needed = GOVERNOR_ENABLED || seconds_hand_duration
+	    || preset_switching == PRESETS_ON_DOUBLE_TAP;
 
-	if (!bluetooth_connected && IS_VISIBLE(bluetooth_color)) {
-		pt.x = center.x;
-		pt.y = center.y + (has_battery ? +1 : -2);
-		gpath_move_to(bluetooth_frame, pt);
-		gpath_move_to(bluetooth_logo, pt);
-		graphics_context_set_stroke_color(ctx, bluetooth_color);
-		gpath_draw_outline(ctx, bluetooth_frame);
-#ifdef PBL_SDK_3
-		gpath_draw_outline_open(ctx, bluetooth_logo);
-#else
-		gpath_draw_outline(ctx, bluetooth_logo);
+	if (needed == tap_subscribed) return;
+
+	tap_subscribed = needed;
+	if (needed) accel_tap_service_subscribe(&tap_handler);
+	else accel_tap_service_unsubscribe();
+}
+
+/*
+ * Applies the differences between two configurations: at most one font
+ * relayout, one text update and one invalidation.
+ */
+static void
+apply_config(const struct config *old_config,
+    const struct config *new_config) {
+	set_config(new_config);
+
+#ifndef CACHE_BACKGROUND
+	if (!IS_EQUAL(new_config->background_color,
+	    old_config->background_color))
+		window_set_background_color(window, background_color);
+#endif
+#if !defined(CACHE_BACKGROUND) && !defined(SINGLE_LAYER)
+	layer_set_hidden(background_layer, BACKGROUND_IS_PLAIN);
 #endif
+
+	if (new_config->text_font != old_config->text_font)
+		update_text_font();
+
+	if (memcmp(new_config->text_format, old_config->text_format,
+	    sizeof text_format)) {
+		text_update_unit = format_update_unit(text_format);
+		update_text_layer(&tm_now);
 	}
 
-	if (!has_battery
-	    && (IS_VISIBLE(battery_color) || IS_VISIBLE(battery_color2))) {
-		pt.x = center.x - 11;
-		pt.y = center.y
-		    + (bluetooth_connected ? 0 : PBL_IF_RECT_ELSE(9, 11));
-		graphics_context_set_fill_color(ctx, battery_color);
-		graphics_fill_rect(ctx,
-		    GRect(pt.x, pt.y, 22, 7),
-		    0, GCornerNone);
-		graphics_fill_rect(ctx,
-		    GRect(pt.x + 22, pt.y + 2, 2, 3),
-		    0, GCornerNone);
-		if (!IS_EQUAL(battery_color2, battery_color)) {
-			graphics_context_set_fill_color(ctx, battery_color2);
-			graphics_fill_rect(ctx,
-			    GRect(pt.x + 5, pt.y + 1, 4, 5),
-			    0, GCornerNone);
-			graphics_fill_rect(ctx,
-			    GRect(pt.x + 13, pt.y + 1, 4, 5),
-			    0, GCornerNone);
-		}
-		graphics_context_set_fill_color(ctx, background_color);
-		if (current_battery < 100)
-			graphics_fill_rect(ctx,
-			    GRect(pt.x + 1 + current_battery / 5, pt.y + 1,
-			    20 - current_battery / 5, 5),
-			    0, GCornerNone);
+	update_tap_subscription();
+	update_elements();
+}
+
+static void
+write_preset(uint8_t slot, const struct config *config) {
+	uint8_t buffer[PERSIST_BUFFER_SIZE];
+	int i, size = encode_config(config, buffer);
+
+	i = persist_write_data(PRESET_FIRST_KEY + slot - 1, buffer, size);
+	if (i != size)
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "error while writing preset %u (%d)", (unsigned)slot, i);
+}
+
+/*
+ * Reads a stored preset over config, keeping the settings that decide
+ * when presets are switched. Returns false when the slot is empty.
+ */
+static bool
+read_preset(uint8_t slot, struct config *config) {
+	uint8_t buffer[PERSIST_BUFFER_SIZE];
+	struct config result = *config;
+	int size;
+
+	size = persist_read_data(PRESET_FIRST_KEY + slot - 1,
+	    buffer, sizeof buffer);
+	if (size < 1) return false;
+
+	if (!decode_config(buffer, size, &result)) {
+		APP_LOG(APP_LOG_LEVEL_ERROR,
+		    "invalid preset %u", (unsigned)slot);
+		return false;
 	}
+
+	result.quiet_start_hour = config->quiet_start_hour;
+	result.quiet_end_hour = config->quiet_end_hour;
+	result.preset_switching = config->preset_switching;
+	*config = result;
+	return true;
 }
 
+/* only the index is written, the preset itself being already stored */
 static void
-update_text_layer(struct tm *time) {
-	strftime(text_buffer, sizeof text_buffer, text_format, time);
-	text_layer_set_text(text_layer, text_buffer);
+set_current_preset(uint8_t slot) {
+	if (slot == current_preset) return;
+
+	current_preset = slot;
+	persist_write_int(CURRENT_PRESET_KEY, slot);
+	COUNT_EVENT(COUNT_CONFIG_WRITES);
 }
 
+/* the preset active when the face last exited, over the stored config */
 static void
-update_text_font(unsigned new_text_font) {
-	Layer *window_layer = window_get_root_layer(window);
-	GRect bounds = layer_get_bounds(window_layer);
+read_current_preset(void) {
+	struct config config;
+	int32_t slot = persist_read_int(CURRENT_PRESET_KEY);
+
+	if (slot < 1 || slot > PRESET_NUMBER) return;
+
+	get_config(&config);
+	if (!read_preset(slot, &config)) return;
+
+	current_preset = slot;
+	set_config(&config);
+	text_update_unit = format_update_unit(text_format);
+}
+
+static bool
+switch_preset(uint8_t slot) {
+	struct config old_config, new_config;
 
-	if (new_text_font >= TEXT_FONT_NUMBER) return;
+	get_config(&old_config);
+	new_config = old_config;
+	if (!read_preset(slot, &new_config)) return false;
 
-	if (text_layer) {
-		if (new_text_font == text_font) return;
-		text_layer_destroy(text_layer);
+	set_current_preset(slot);
+	if (memcmp(&new_config, &old_config, sizeof new_config))
+		apply_config(&old_config, &new_config);
+	return true;
+}
+
+/* the first stored preset after the current one */
+static void
+switch_to_next_preset(void) {
+	uint8_t i, slot = current_preset;
+
+	for (i = 0; i < PRESET_NUMBER; i += 1) {
+		slot = slot % PRESET_NUMBER + 1;
+		if (switch_preset(slot)) return;
 	}
+}
 
-	text_font = new_text_font;
+static void
+schedule_preset(int hour) {
+	uint8_t slot;
 
-	text_layer = text_layer_create(GRect(
-	    bounds.origin.x,
-	    bounds.origin.y + text_offsets[text_font],
-	    bounds.size.w,
-	    text_heights[text_font]));
-	text_layer_set_text_color(text_layer, text_color);
-	text_layer_set_background_color(text_layer, GColorClear);
-	text_layer_set_text_alignment(text_layer, GTextAlignmentCenter);
-	text_layer_set_font(text_layer,
-	    fonts_get_system_font(text_fonts[text_font]));
-	layer_set_hidden(text_layer_get_layer(text_layer),
-	    !text_format[0] || !IS_VISIBLE(text_color));
-	layer_insert_below_sibling(text_layer_get_layer(text_layer),
-	    icon_layer);
+	if (preset_switching != PRESETS_ON_QUIET_HOURS) return;
+
+	slot = in_quiet_hours(hour) ? 2 : 1;
+	if (slot != current_preset) switch_preset(slot);
+}
+
+/* a second tap soon after the first one, once per pair */
+static void
+preset_tap(void) {
+	time_t now = time(0);
+
+	if (preset_switching != PRESETS_ON_DOUBLE_TAP) return;
+
+	if (last_tap && now - last_tap <= DOUBLE_TAP_SECONDS) {
+		last_tap = 0;
+		switch_to_next_preset();
+	} else {
+		last_tap = now;
+	}
 }
 
 /********************
@@ -706,65 +2601,114 @@ static void
 battery_handler(BatteryChargeState charge) {
 	if (current_battery == charge.charge_percent) return;
 	current_battery = charge.charge_percent;
-	ICON_LAYER_SET_HIDDEN;
-	if (!has_battery) layer_mark_dirty(icon_layer);
+	update_elements();
 }
 
+/* at most vibrations_per_hour pulses in each hour since the first one */
 static void
-bluetooth_handler(bool connected) {
-	bluetooth_connected = connected;
-	ICON_LAYER_SET_HIDDEN;
-	layer_mark_dirty(icon_layer);
+bluetooth_vibrate(void) {
+	time_t now = time(0);
+
+	if (now - vibration_window_start >= 3600) {
+		vibration_window_start = now;
+		vibration_count = 0;
+	}
+
+	if (vibrations_per_hour && vibration_count >= vibrations_per_hour)
+		return;
+
+	vibration_count += 1;
+	vibes_long_pulse();
+	COUNT_EVENT(COUNT_VIBRATIONS);
+}
+
+/* the displayed state follows the link once it has been stable enough */
+static void
+bluetooth_settle(void *data) {
+	(void)data;
+
+	bluetooth_timer = 0;
+	if (bluetooth_connected == bluetooth_link) return;
+
+	bluetooth_connected = bluetooth_link;
+	update_elements();
+
+	if (bluetooth_vibration && !bluetooth_connected) bluetooth_vibrate();
+}
 
-	if (bluetooth_vibration && !connected) vibes_long_pulse();
+/*
+ * Link changes shorter than bluetooth_hysteresis seconds are ignored, so
+ * a flapping connection does not redraw the icon or vibrate each time.
+ */
+static void
+bluetooth_handler(bool connected) {
+	if (connected != bluetooth_link)
+		COUNT_EVENT(COUNT_CONNECTION_TOGGLES);
+	bluetooth_link = connected;
+
+	if (!bluetooth_hysteresis) {
+		bluetooth_settle(0);
+	} else if (bluetooth_link == bluetooth_connected) {
+		if (bluetooth_timer) app_timer_cancel(bluetooth_timer);
+		bluetooth_timer = 0;
+	} else if (!bluetooth_timer) {
+		bluetooth_timer = app_timer_register(
+		    bluetooth_hysteresis * 1000, &bluetooth_settle, 0);
+	}
 }
 
+/*
+ * Incoming settings are staged into a copy of the current ones, then only
+ * the differences are applied in one pass, the result being stored as a
+ * preset when requested.
+ */
 static void
 inbox_received_handler(DictionaryIterator *iterator, void *context) {
+	struct config old_config, new_config;
+	bool counters_requested = false;
+	bool timings_requested = false;
+	uint8_t preset_slot = 0;
 	Tuple *tuple;
 
 	(void)context;
 
+	get_config(&old_config);
+	new_config = old_config;
+
 	for (tuple = dict_read_first(iterator);
 	    tuple;
 	    tuple = dict_read_next(iterator)) {
 		switch (tuple->key) {
 		    case 1:
-			background_color = color_from_tuple(tuple);
-			window_set_background_color(window, background_color);
+			new_config.background_color = color_from_tuple(tuple);
 			break;
 		    case 2:
-			battery_color = color_from_tuple(tuple);
-			layer_mark_dirty(icon_layer);
+			new_config.battery_color = color_from_tuple(tuple);
 			break;
 		    case 3:
-			bluetooth_color = color_from_tuple(tuple);
-			layer_mark_dirty(icon_layer);
+			new_config.bluetooth_color = color_from_tuple(tuple);
 			break;
 		    case 4:
-			hour_hand_color = color_from_tuple(tuple);
-			pin_color = minute_hand_color = hour_hand_color;
-			layer_mark_dirty(hand_layer);
+			new_config.hour_hand_color = color_from_tuple(tuple);
+			new_config.minute_hand_color
+			    = new_config.pin_color
+			    = new_config.hour_hand_color;
 			break;
 		    case 5:
-			hour_mark_color = color_from_tuple(tuple);
-			layer_mark_dirty(background_layer);
+			new_config.hour_mark_color = color_from_tuple(tuple);
 			break;
 		    case 6:
-			inner_rectangle_color = color_from_tuple(tuple);
-			layer_mark_dirty(background_layer);
+			new_config.inner_rectangle_color
+			    = color_from_tuple(tuple);
 			break;
 		    case 7:
-			minute_mark_color = color_from_tuple(tuple);
-			layer_mark_dirty(background_layer);
+			new_config.minute_mark_color = color_from_tuple(tuple);
 			break;
 		    case 8:
-			text_color = color_from_tuple(tuple);
-			text_layer_set_text_color(text_layer, text_color);
+			new_config.text_color = color_from_tuple(tuple);
 			break;
 		    case 9:
-			battery_color2 = color_from_tuple(tuple);
-			layer_mark_dirty(icon_layer);
+			new_config.battery_color2 = color_from_tuple(tuple);
 			break;
 		    case 10:
 			if (tuple->type != TUPLE_INT
@@ -778,14 +2722,15 @@ inbox_received_handler(DictionaryIterator *iterator, void *context) {
 				    "bad value %u for text_font entry",
 				    (unsigned)tuple->value->uint8);
 			else
-				update_text_font(tuple->value->uint8 - 1);
-				update_text_layer(&tm_now);
+				new_config.text_font = tuple->value->uint8 - 1;
 			break;
 		    case 11:
 			if (tuple->type == TUPLE_CSTRING) {
-				strncpy(text_format, tuple->value->cstring,
-				   sizeof text_format);
-				update_text_layer(&tm_now);
+				strncpy(new_config.text_format,
+				    tuple->value->cstring,
+				    sizeof new_config.text_format - 1);
+				new_config.text_format
+				    [sizeof new_config.text_format - 1] = 0;
 			} else
 				APP_LOG(APP_LOG_LEVEL_ERROR,
 				    "bad type %d for text_format entry",
@@ -794,7 +2739,7 @@ inbox_received_handler(DictionaryIterator *iterator, void *context) {
 		    case 12:
 			if (tuple->type == TUPLE_INT
 			    || tuple->type == TUPLE_UINT)
-				bluetooth_vibration
+				new_config.bluetooth_vibration
 				    = tuple->value->data[0] != 0;
 			else
 				APP_LOG(APP_LOG_LEVEL_ERROR,
@@ -803,27 +2748,72 @@ inbox_received_handler(DictionaryIterator *iterator, void *context) {
 			break;
 		    case 13:
 			if (tuple->type == TUPLE_INT)
-				show_battery_icon_below
+				new_config.show_battery_icon_below
 				    = (tuple->value->int8 < 0) ? 0
 				    : tuple->value->int8;
 			else if (tuple->type == TUPLE_UINT)
-				show_battery_icon_below = tuple->value->uint8;
+				new_config.show_battery_icon_below
+				    = tuple->value->uint8;
 			else
 				APP_LOG(APP_LOG_LEVEL_ERROR, "bad type %d for "
 				    "show_battery_icon_below entry",
 				    (int)tuple->type);
 			break;
+		    case 14:
+			read_small_uint(tuple, 24, "quiet_start_hour",
+			    &new_config.quiet_start_hour);
+			break;
+		    case 15:
+			read_small_uint(tuple, 24, "quiet_end_hour",
+			    &new_config.quiet_end_hour);
+			break;
+		    case 16:
+			read_small_uint(tuple, 256, "idle_minutes",
+			    &new_config.idle_minutes);
+			break;
+		    case 17:
+			read_small_uint(tuple, 256, "seconds_hand_duration",
+			    &new_config.seconds_hand_duration);
+			break;
+		    case 18:
+			read_small_uint(tuple, 256, "bluetooth_hysteresis",
+			    &new_config.bluetooth_hysteresis);
+			break;
+		    case 19:
+			read_small_uint(tuple, 256, "vibrations_per_hour",
+			    &new_config.vibrations_per_hour);
+			break;
 		    case 20:
-			hour_hand_color = color_from_tuple(tuple);
-			layer_mark_dirty(hand_layer);
+			new_config.hour_hand_color = color_from_tuple(tuple);
 			break;
 		    case 21:
-			minute_hand_color = color_from_tuple(tuple);
-			layer_mark_dirty(hand_layer);
+			new_config.minute_hand_color = color_from_tuple(tuple);
 			break;
 		    case 22:
-			pin_color = color_from_tuple(tuple);
-			layer_mark_dirty(hand_layer);
+			new_config.pin_color = color_from_tuple(tuple);
+			break;
+		    case 23:
+			/* every setting at once, in the storage format */
+			if (tuple->type != TUPLE_BYTE_ARRAY
+			    || !decode_config(tuple->value->data,
+			    tuple->length, &new_config))
+				APP_LOG(APP_LOG_LEVEL_ERROR,
+				    "bad packed configuration entry");
+			break;
+		    case 24:
+			/* requests for statistics, any value */
+			counters_requested = true;
+			break;
+		    case 25:
+			timings_requested = true;
+			break;
+		    case 26:
+			read_small_uint(tuple, PRESET_NUMBER + 1, "preset_slot",
+			    &preset_slot);
+			break;
+		    case 27:
+			read_small_uint(tuple, PRESETS_ON_QUIET_HOURS + 1,
+			    "preset_switching", &new_config.preset_switching);
 			break;
 		    default:
 			APP_LOG(APP_LOG_LEVEL_ERROR,
@@ -832,31 +2822,50 @@ inbox_received_handler(DictionaryIterator *iterator, void *context) {
 		}
 	}
 
-#ifdef CACHE_BACKGROUND
-	use_background_cache = !IS_VISIBLE(inner_rectangle_color)
-	    && !IS_VISIBLE(hour_mark_color)
-	    && !IS_VISIBLE(minute_mark_color);
-	layer_set_hidden(background_layer, use_background_cache);
-#else
-	layer_set_hidden(background_layer,
-	    !IS_VISIBLE(inner_rectangle_color)
-	    && !IS_VISIBLE(hour_mark_color)
-	    && !IS_VISIBLE(minute_mark_color));
-#endif
-
-	ICON_LAYER_SET_HIDDEN;
+	if (counters_requested || timings_requested)
+		send_statistics(counters_requested, timings_requested);
 
-	layer_set_hidden(text_layer_get_layer(text_layer),
-	    !text_format[0] || !IS_VISIBLE(text_color));
+	if (preset_slot) {
+		write_preset(preset_slot, &new_config);
+		set_current_preset(preset_slot);
+	}
 
+	if (!memcmp(&new_config, &old_config, sizeof new_config)) return;
+	if (!preset_slot) set_current_preset(0);
+	governor_wake();
+	apply_config(&old_config, &new_config);
 	write_config();
+
+	/* a configuration just saved as a preset stays shown */
+	if (!preset_slot) schedule_preset(tm_now.tm_hour);
+}
+
+static void
+tap_handler(AccelAxisType axis, int32_t direction) {
+	(void)axis;
+	(void)direction;
+	governor_wake();
+	preset_tap();
+
+	if (!seconds_hand_duration) return;
+	seconds_hand_until = time(0) + seconds_hand_duration;
+	set_seconds_hand(true);
 }
 
 static void
 tick_handler(struct tm* tick_time, TimeUnits units_changed) {
-	if (tm_now.tm_mday != tick_time->tm_mday) update_text_layer(tick_time);
+	if (GOVERNOR_ENABLED && (units_changed & MINUTE_UNIT))
+		governor_tick(tick_time);
+	if (units_changed & HOUR_UNIT) schedule_preset(tick_time->tm_hour);
+	if (!reduced_rendering && (units_changed & text_update_unit))
+		update_text_layer(tick_time);
 	tm_now = *tick_time;
-	layer_mark_dirty(hand_layer);
+	update_hands(false);
+
+	if (seconds_hand_shown && time(0) >= seconds_hand_until)
+		set_seconds_hand(false);
+	update_seconds_hand();
+	write_energy_counters(false);
 }
 
 /***********************************
@@ -867,47 +2876,88 @@ static void
 window_load(Window *window) {
 	Layer *window_layer = window_get_root_layer(window);
 	GRect bounds = layer_get_bounds(window_layer);
+#ifdef CACHE_BACKGROUND
+	window_set_background_color(window, GColorClear);
+#else
 	window_set_background_color(window, background_color);
+#endif
 
 	center = grect_center_point(&bounds);
-	gpath_move_to(hour_hand_path, center);
-	gpath_move_to(minute_hand_path, center);
 
 	background_layer = layer_create(bounds);
 	layer_set_update_proc(background_layer, &background_layer_draw);
 #ifdef CACHE_BACKGROUND
-	use_background_cache = !IS_VISIBLE(inner_rectangle_color)
-	    && !IS_VISIBLE(hour_mark_color)
-	    && !IS_VISIBLE(minute_mark_color);
-	layer_set_hidden(background_layer, use_background_cache);
-#else
-	layer_set_hidden(background_layer,
-	    !IS_VISIBLE(inner_rectangle_color)
-	    && !IS_VISIBLE(hour_mark_color)
-	    && !IS_VISIBLE(minute_mark_color));
+	use_background_cache = false;
+	read_stored_marks_header();
+	warm_start = true;
+	dirty_rect = bounds;
+#elif !defined(SINGLE_LAYER)
+	layer_set_hidden(background_layer, BACKGROUND_IS_PLAIN);
 #endif
 	layer_add_child(window_layer, background_layer);
 
-	icon_layer = layer_create(GRect(bounds.origin.x
-	    + (bounds.size.w - 33) / 2, PBL_IF_RECT_ELSE(97, 105), 33, 36));
+	icon_frame = GRect(bounds.origin.x + (bounds.size.w - 33) / 2,
+	    PBL_IF_RECT_ELSE(97, 105), 33, 36);
+	text_buffer[0] = 0;
+	update_text_font();
+	update_text_layer(&tm_now);
+
+#ifndef SINGLE_LAYER
+	icon_layer = layer_create(icon_frame);
 	layer_set_update_proc(icon_layer, &icon_layer_draw);
-	ICON_LAYER_SET_HIDDEN;
 	layer_add_child(window_layer, icon_layer);
 
-	update_text_font(text_font);
-	update_text_layer(&tm_now);
+	text_layer = layer_create(text_frame);
+	layer_set_update_proc(text_layer, &text_layer_draw);
+	layer_add_child(window_layer, text_layer);
+
+#ifdef CACHE_BACKGROUND
+	cache_layer = layer_create(bounds);
+	layer_set_update_proc(cache_layer, &cache_layer_draw);
+	layer_add_child(window_layer, cache_layer);
+#endif
+
+	minute_hand_layer = layer_create(GRectZero);
+	layer_set_update_proc(minute_hand_layer, &minute_hand_layer_draw);
+	layer_add_child(window_layer, minute_hand_layer);
+
+	hour_hand_layer = layer_create(GRectZero);
+	layer_set_update_proc(hour_hand_layer, &hour_hand_layer_draw);
+	layer_add_child(window_layer, hour_hand_layer);
+
+	seconds_hand_layer = layer_create(GRectZero);
+	layer_set_update_proc(seconds_hand_layer, &seconds_hand_layer_draw);
+	layer_set_hidden(seconds_hand_layer, true);
+	layer_add_child(window_layer, seconds_hand_layer);
 
-	hand_layer = layer_create(bounds);
-	layer_set_update_proc(hand_layer, &hand_layer_draw);
-	layer_add_child(window_layer, hand_layer);
+	pin_layer = layer_create(PIN_FRAME);
+	layer_set_update_proc(pin_layer, &pin_layer_draw);
+	layer_add_child(window_layer, pin_layer);
+#endif
+
+	update_elements();
+	minute_hand_box = hour_hand_box = GRectZero;
+	update_hands(true);
 }
 
 static void
 window_unload(Window *window) {
+#ifdef CACHE_BACKGROUND
+	free_background_cache();
+#endif
 	layer_destroy(background_layer);
-	layer_destroy(hand_layer);
+#ifndef SINGLE_LAYER
+	layer_destroy(hour_hand_layer);
+	layer_destroy(minute_hand_layer);
+	layer_destroy(pin_layer);
+	layer_destroy(seconds_hand_layer);
 	layer_destroy(icon_layer);
-	text_layer_destroy(text_layer);
+	layer_destroy(text_layer);
+	text_layer = 0;
+#ifdef CACHE_BACKGROUND
+	layer_destroy(cache_layer);
+#endif
+#endif
 }
 
 static void
@@ -934,8 +2984,11 @@ init(void) {
 	battery_color2 = battery_color;
 
 	bluetooth_connected = connection_service_peek_pebble_app_connection();
+	bluetooth_link = bluetooth_connected;
 	current_battery = battery_state_service_peek().charge_percent;
+	read_energy_counters();
 	read_config();
+	read_current_preset();
 
 	window = window_create();
 	window_set_window_handlers(window, (WindowHandlers) {
@@ -943,20 +2996,19 @@ init(void) {
 		.unload = window_unload,
 	});
 
-	bluetooth_frame = gpath_create(&bluetooth_frame_points);
-	bluetooth_logo = gpath_create(&bluetooth_logo_points);
-	hour_hand_path = gpath_create(&hour_hand_path_points);
-	minute_hand_path = gpath_create(&minute_hand_path_points);
-
 	battery_state_service_subscribe(&battery_handler);
 	connection_service_subscribe(((ConnectionHandlers){
 	    .pebble_app_connection_handler = &bluetooth_handler,
 	    .pebblekit_connection_handler = 0}));
 	tick_timer_service_subscribe(MINUTE_UNIT, &tick_handler);
+	update_tap_subscription();
+	last_activity = current_time;
 	window_stack_push(window, true);
+	schedule_preset(tm_now.tm_hour);
 
 	app_message_register_inbox_received(inbox_received_handler);
-	app_message_open(1024, 0);
+	app_message_open(dict_calc_buffer_size(2, PERSIST_BUFFER_SIZE,
+	    sizeof(uint32_t)), OUTBOX_SIZE);
 }
 
 static void
@@ -964,11 +3016,12 @@ deinit(void) {
 	battery_state_service_unsubscribe();
 	connection_service_unsubscribe();
 	tick_timer_service_unsubscribe();
-	gpath_destroy(bluetooth_frame);
-	gpath_destroy(bluetooth_logo);
-	gpath_destroy(hour_hand_path);
-	gpath_destroy(minute_hand_path);
+	accel_tap_service_unsubscribe();
+	tap_subscribed = false;
+	if (bluetooth_timer) app_timer_cancel(bluetooth_timer);
+	free_icon_bitmaps();
 	window_destroy(window);
+	write_energy_counters(true);
 }
 
 int
@@ -0,0 +1,95 @@
+/* Generated by tools/gen-geometry.py, do not edit. */
+
+#define HAND_POSITIONS 720
+#define HAND_UNIT_SHIFT 15
+
+/* sin(2 * pi * i / HAND_POSITIONS) << HAND_UNIT_SHIFT */
+static const uint16_t hand_unit[181] = {
+	    0,   286,   572,   858,  1144,  1429,  1715,  2000,
+	 2286,  2571,  2856,  3141,  3425,  3709,  3993,  4277,
+	 4560,  4843,  5126,  5408,  5690,  5971,  6252,  6533,
+	 6813,  7092,  7371,  7650,  7927,  8204,  8481,  8757,
+	 9032,  9307,  9580,  9854, 10126, 10397, 10668, 10938,
+	11207, 11476, 11743, 12010, 12275, 12540, 12803, 13066,
+	13328, 13589, 13848, 14107, 14365, 14621, 14876, 15131,
+	15384, 15636, 15886, 16136, 16384, 16631, 16877, 17121,
+	17364, 17606, 17847, 18086, 18324, 18560, 18795, 19028,
+	19261, 19491, 19720, 19948, 20174, 20399, 20622, 20843,
+	21063, 21281, 21498, 21713, 21926, 22138, 22348, 22556,
+	22763, 22967, 23170, 23372, 23571, 23769, 23965, 24159,
+	24351, 24542, 24730, 24917, 25102, 25285, 25466, 25645,
+	25822, 25997, 26170, 26341, 26510, 26677, 26842, 27005,
+	27166, 27325, 27482, 27636, 27789, 27939, 28088, 28234,
+	28378, 28520, 28660, 28797, 28932, 29066, 29197, 29325,
+	29452, 29576, 29698, 29818, 29935, 30050, 30163, 30274,
+	30382, 30488, 30592, 30693, 30792, 30888, 30983, 31075,
+	31164, 31251, 31336, 31419, 31499, 31576, 31651, 31724,
+	31795, 31863, 31928, 31991, 32052, 32110, 32166, 32219,
+	32270, 32319, 32365, 32408, 32449, 32488, 32524, 32557,
+	32588, 32617, 32643, 32667, 32688, 32707, 32723, 32737,
+	32748, 32757, 32763, 32767, 32768,
+};
+
+/* mark segments as { x1, y1, x2, y2 } in window coordinates */
+
+#ifdef PBL_RECT
+static const uint8_t minute_marks[60][4] = {
+	{  71,   5,  72,   5 }, {  79,   5,  80,   5 }, {  88,   5,  89,   5 },
+	{  97,   5,  98,   5 }, { 106,   5, 107,   5 }, { 116,   5, 117,   5 },
+	{ 128,   5, 129,   5 }, { 138,  10, 138,  11 }, { 138,  24, 138,  25 },
+	{ 138,  35, 138,  36 }, { 138,  45, 138,  46 }, { 138,  54, 138,  55 },
+	{ 138,  62, 138,  63 }, { 138,  69, 138,  70 }, { 138,  77, 138,  78 },
+	{ 138,  83, 138,  84 }, { 138,  90, 138,  91 }, { 138,  97, 138,  98 },
+	{ 138, 105, 138, 106 }, { 138, 113, 138, 114 }, { 138, 121, 138, 122 },
+	{ 138, 131, 138, 132 }, { 138, 143, 138, 144 }, { 138, 157, 138, 158 },
+	{ 128, 162, 129, 162 }, { 116, 162, 117, 162 }, { 106, 162, 107, 162 },
+	{  97, 162,  98, 162 }, {  88, 162,  89, 162 }, {  79, 162,  80, 162 },
+	{  71, 162,  72, 162 }, {  63, 162,  64, 162 }, {  55, 162,  56, 162 },
+	{  46, 162,  47, 162 }, {  37, 162,  38, 162 }, {  26, 162,  27, 162 },
+	{  14, 162,  15, 162 }, {   5, 157,   5, 158 }, {   5, 143,   5, 144 },
+	{   5, 131,   5, 132 }, {   5, 121,   5, 122 }, {   5, 113,   5, 114 },
+	{   5, 105,   5, 106 }, {   5,  97,   5,  98 }, {   5,  90,   5,  91 },
+	{   5,  83,   5,  84 }, {   5,  77,   5,  78 }, {   5,  69,   5,  70 },
+	{   5,  62,   5,  63 }, {   5,  54,   5,  55 }, {   5,  45,   5,  46 },
+	{   5,  35,   5,  36 }, {   5,  24,   5,  25 }, {   5,  10,   5,  11 },
+	{  14,   5,  15,   5 }, {  26,   5,  27,   5 }, {  37,   5,  38,   5 },
+	{  46,   5,  47,   5 }, {  55,   5,  56,   5 }, {  63,   5,  64,   5 },
+};
+
+static const uint8_t hour_marks[12][4] = {
+	{  71,  11,  71,  22 }, { 113,  11, 107,  22 }, { 132,  49, 121,  55 },
+	{ 132,  83, 121,  83 }, { 132, 118, 121, 112 }, { 113, 156, 107, 145 },
+	{  71, 156,  71, 145 }, {  30, 156,  36, 145 }, {  11, 118,  22, 112 },
+	{  11,  83,  22,  83 }, {  11,  49,  22,  55 }, {  30,  11,  36,  22 },
+};
+#else
+static const uint8_t minute_marks[60][4] = {
+	{  89,   5,  91,   5 }, {  98,   5, 100,   6 }, { 107,   7, 109,   7 },
+	{ 115,   9, 117,   9 }, { 124,  12, 125,  13 }, { 132,  16, 133,  17 },
+	{ 139,  21, 141,  22 }, { 146,  26, 148,  27 }, { 153,  32, 154,  34 },
+	{ 158,  39, 159,  41 }, { 163,  47, 164,  48 }, { 167,  55, 168,  56 },
+	{ 171,  63, 171,  65 }, { 173,  71, 173,  73 }, { 174,  80, 175,  82 },
+	{ 175,  89, 175,  91 }, { 175,  98, 174, 100 }, { 173, 107, 173, 109 },
+	{ 171, 115, 171, 117 }, { 168, 124, 167, 125 }, { 164, 132, 163, 133 },
+	{ 159, 139, 158, 141 }, { 154, 146, 153, 148 }, { 148, 153, 146, 154 },
+	{ 141, 158, 139, 159 }, { 133, 163, 132, 164 }, { 125, 167, 124, 168 },
+	{ 117, 171, 115, 171 }, { 109, 173, 107, 173 }, { 100, 174,  98, 175 },
+	{  91, 175,  89, 175 }, {  82, 175,  80, 174 }, {  73, 173,  71, 173 },
+	{  65, 171,  63, 171 }, {  56, 168,  55, 167 }, {  48, 164,  47, 163 },
+	{  41, 159,  39, 158 }, {  34, 154,  32, 153 }, {  27, 148,  26, 146 },
+	{  22, 141,  21, 139 }, {  17, 133,  16, 132 }, {  13, 125,  12, 124 },
+	{   9, 117,   9, 115 }, {   7, 109,   7, 107 }, {   6, 100,   5,  98 },
+	{   5,  91,   5,  89 }, {   5,  82,   6,  80 }, {   7,  73,   7,  71 },
+	{   9,  65,   9,  63 }, {  12,  56,  13,  55 }, {  16,  48,  17,  47 },
+	{  21,  41,  22,  39 }, {  26,  34,  27,  32 }, {  32,  27,  34,  26 },
+	{  39,  22,  41,  21 }, {  47,  17,  48,  16 }, {  55,  13,  56,  12 },
+	{  63,   9,  65,   9 }, {  71,   7,  73,   7 }, {  80,   6,  82,   5 },
+};
+
+static const uint8_t hour_marks[12][4] = {
+	{  90,  11,  90,  22 }, { 129,  22, 123,  32 }, { 158,  51, 148,  56 },
+	{ 169,  90, 158,  90 }, { 158, 129, 148, 123 }, { 129, 158, 124, 148 },
+	{  90, 169,  90, 158 }, {  51, 158,  57, 148 }, {  22, 129,  32, 124 },
+	{  11,  90,  22,  90 }, {  22,  51,  32,  57 }, {  51,  22,  56,  32 },
+};
+#endif
@@ -27,9 +27,16 @@ const settings = {  /* "name in local storage": "form input parameter" */
   "batteryColor2":       "battcol2",
   "bluetoothColor":      "bluetooth",
   "bluetoothVibration":  "vibrate",
+  "bluetoothDelay":      "btdelay",
+  "vibrationLimit":      "vibelimit",
   "textColor":           "textcol",
   "textFormat":          "textfmt",
   "textFont":            "font",
+  "quietStart":          "qstart",
+  "quietEnd":            "qend",
+  "idleMinutes":         "idle",
+  "secondsDuration":     "seconds",
+  "presetSwitching":     "presets",
 };
 
 function encodeStored(names) {
@@ -57,12 +64,629 @@ function encodeStored(names) {
   return result;
 }
 
+/*
+ * Settings packed like the watch storage format (version 8): fields in
+ * config_schema order, least significant bit first, colors as an opacity
+ * bit and 2 bits per channel, the text format as length and UTF-8 bytes.
+ */
+function packConfig(configData) {
+  var bytes = [8];
+  var position = 8;
+
+  function put(value, bits) {
+    for (var i = 0; i < bits; i++, position++) {
+      if (position % 8 == 0) bytes.push(0);
+      if ((value >> i) & 1) bytes[position >> 3] |= 1 << (position & 7);
+    }
+  }
+
+  function putColor(name) {
+    var value = parseInt(configData[name]);
+    put(0x40 | ((value >> 22) & 3) << 4 | ((value >> 14) & 3) << 2
+      | ((value >> 6) & 3), 7);
+  }
+
+  function putInt(name, bits) {
+    var value = parseInt(configData[name]);
+    put(isNaN(value) ? 0 : Math.max(0, Math.min(value, (1 << bits) - 1)), bits);
+  }
+
+  putColor("backgroundColor");
+  putColor("batteryColor");
+  putColor("batteryColor2");
+  putColor("bluetoothColor");
+  putColor("hourHandColor");
+  putColor("minuteHandColor");
+  putColor("pinColor");
+  putColor("hourColor");
+  putColor("innerColor");
+  putColor("minuteColor");
+  putColor("textColor");
+  put(Math.max(0, Math.min(parseInt(configData["textFont"]) - 1, 3)) || 0, 2);
+  put(parseInt(configData["bluetoothVibration"]) ? 1 : 0, 1);
+  putInt("lowBatteryLevel", 8);
+  putInt("quietStart", 5);
+  putInt("quietEnd", 5);
+  putInt("idleMinutes", 8);
+  putInt("secondsDuration", 8);
+  putInt("bluetoothDelay", 8);
+  putInt("vibrationLimit", 8);
+  putInt("presetSwitching", 2);
+
+  var text = unescape(encodeURIComponent(configData["textFormat"] || ""));
+  text = text.substring(0, 31);
+  put(text.length, 5);
+  for (var i = 0; i < text.length; i++) {
+    put(text.charCodeAt(i), 8);
+  }
+
+  return bytes;
+}
+
+const messageKeys = {  /* "name in configuration": AppMessage key */
+  "backgroundColor":     1,
+  "batteryColor":        2,
+  "bluetoothColor":      3,
+  "hourColor":           5,
+  "innerColor":          6,
+  "minuteColor":         7,
+  "textColor":           8,
+  "batteryColor2":       9,
+  "textFont":            10,
+  "textFormat":          11,
+  "bluetoothVibration":  12,
+  "lowBatteryLevel":     13,
+  "quietStart":          14,
+  "quietEnd":            15,
+  "idleMinutes":         16,
+  "secondsDuration":     17,
+  "bluetoothDelay":      18,
+  "vibrationLimit":      19,
+  "hourHandColor":       20,
+  "minuteHandColor":     21,
+  "pinColor":            22,
+  "presetSwitching":     27,
+};
+
+/*
+ * Only the settings changed since the last configuration the watch
+ * acknowledged, as individual keys, unless the packed tuple is smaller
+ * or nothing was ever acknowledged. Returns null when nothing changed.
+ * Everything is sent when presets are switched on the watch, since the
+ * acknowledged configuration may no longer be the current one.
+ */
+function configDelta(configData) {
+  var packed = packConfig(configData);
+  var acked = JSON.parse(localStorage.getItem("ackedConfig"));
+  var dict = {};
+  var size = 1;
+  var changed = false;
+
+  if (!acked || parseInt(acked["presetSwitching"])
+      || parseInt(configData["presetSwitching"])) {
+    return { 23: packed };
+  }
+
+  for (var name in messageKeys) {
+    if (String(configData[name]) === String(acked[name])) continue;
+    if (name == "textFormat") {
+      dict[messageKeys[name]] = configData[name];
+      size += 7 + unescape(encodeURIComponent(configData[name])).length + 1;
+    } else {
+      dict[messageKeys[name]] = parseInt(configData[name]);
+      size += 7 + 4;
+    }
+    changed = true;
+  }
+
+  if (!changed) return null;
+  return (size < 1 + 7 + packed.length) ? dict : { 23: packed };
+}
+
+/*
+ * Outgoing messages are sent one at a time, a failed one being retried
+ * with exponential backoff. A queued message of the same kind is replaced
+ * rather than sent twice, and the oldest is dropped when the queue is full.
+ */
+const maxQueuedMessages = 4;
+const maxSendAttempts = 5;
+const firstRetryDelay = 1000;
+var messageQueue = [];
+var messageInFlight = false;
+var retryTimer = null;
+
+function enqueueMessage(entry) {
+  var first = messageInFlight ? 1 : 0;
+  entry.attempts = 0;
+
+  for (var i = first; i < messageQueue.length; i++) {
+    if (messageQueue[i].kind == entry.kind) {
+      messageQueue[i] = entry;
+      sendNextMessage();
+      return;
+    }
+  }
+
+  if (messageQueue.length >= maxQueuedMessages) {
+    console.log("Message queue full, dropping " + messageQueue[first].kind);
+    messageQueue.splice(first, 1);
+  }
+
+  messageQueue.push(entry);
+  sendNextMessage();
+}
+
+function sendNextMessage() {
+  if (messageInFlight || retryTimer || messageQueue.length == 0) return;
+
+  var entry = messageQueue[0];
+  var dict = entry.build();
+  if (!dict) {
+    console.log("Nothing to send for " + entry.kind);
+    messageQueue.shift();
+    sendNextMessage();
+    return;
+  }
+
+  messageInFlight = true;
+  Pebble.sendAppMessage(dict, function() {
+    console.log("Send successful: " + JSON.stringify(dict));
+    messageInFlight = false;
+    messageQueue.shift();
+    entry.acked();
+    sendNextMessage();
+  }, function() {
+    messageInFlight = false;
+    entry.attempts++;
+    if (entry.attempts >= maxSendAttempts) {
+      console.log("Send failed, giving up on " + entry.kind);
+      messageQueue.shift();
+      sendNextMessage();
+      return;
+    }
+    var delay = firstRetryDelay << (entry.attempts - 1);
+    console.log("Send failed, retrying in " + delay + " ms");
+    retryTimer = setTimeout(function() {
+      retryTimer = null;
+      sendNextMessage();
+    }, delay);
+  });
+}
+
+const energyCounterNames = [
+  "frames", "marks", "icons", "text", "hands", "seconds", "pin",
+  "cacheHits", "cacheMisses", "cacheSaves", "configWrites",
+  "vibrations", "connectionToggles",
+];
+
+/* the watch sends its counters as little-endian 32-bit integers */
+function decodeCounters(bytes, names) {
+  var result = {};
+  for (var i = 0; i < names.length && i * 4 + 3 < bytes.length; i++) {
+    result[names[i]] = (bytes[i * 4] | bytes[i * 4 + 1] << 8
+        | bytes[i * 4 + 2] << 16) + bytes[i * 4 + 3] * 0x1000000;
+  }
+  return result;
+}
+
+const frameTimingNames = ["background", "marks", "hands", "icons", "text"];
+const frameTimingBuckets = [
+  "<1ms", "1ms", "2-3ms", "4-7ms", "8-15ms", "16-31ms", "32-63ms", ">=64ms",
+];
+
+/* one little-endian 16-bit count per bucket, element after element */
+function decodeTimings(bytes) {
+  var result = {};
+  var n = frameTimingBuckets.length;
+  for (var i = 0; i < frameTimingNames.length; i++) {
+    var histogram = {};
+    for (var j = 0; j < n; j++) {
+      var k = (i * n + j) * 2;
+      if (k + 1 < bytes.length && (bytes[k] | bytes[k + 1] << 8)) {
+        histogram[frameTimingBuckets[j]] = bytes[k] | bytes[k + 1] << 8;
+      }
+    }
+    result[frameTimingNames[i]] = histogram;
+  }
+  return result;
+}
+
+function requestStatistics() {
+  enqueueMessage({
+    kind: "statistics",
+    build: function() { return { 24: 1, 25: 1 }; },
+    acked: function() {},
+  });
+}
+
 Pebble.addEventListener("ready", function() {
   console.log("Classic-Lite PebbleKit JS ready!");
 });
 
+Pebble.addEventListener("appmessage", function(e) {
+  if (e.payload["24"] !== undefined) {
+    console.log("Energy counters: "
+        + JSON.stringify(decodeCounters(e.payload["24"], energyCounterNames)));
+  }
+  if (e.payload["25"] !== undefined) {
+    console.log("Frame timings since launch: "
+        + JSON.stringify(decodeTimings(e.payload["25"])));
+  }
+});
+
+/* BEGIN config.html, generated by tools/gen-config-page.py */
+const configPage =
+  "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><titl" +
+  "e></title><style>\n" +
+  "/* the parts of the slate theme this page uses, so that it rende" +
+  "rs offline */\n" +
+  "body {\n" +
+  "margin: 0;\n" +
+  "padding: 0 0 15px;\n" +
+  "background-color: #333333;\n" +
+  "color: #ffffff;\n" +
+  "font-family: Helvetica, Arial, sans-serif;\n" +
+  "font-size: 1em;\n" +
+  "}\n" +
+  ".item-container {\n" +
+  "margin: 0 10px 15px;\n" +
+  "}\n" +
+  ".item-container-header, .item-container-footer {\n" +
+  "padding: 10px 5px;\n" +
+  "color: #a4a4a4;\n" +
+  "font-size: 0.9em;\n" +
+  "}\n" +
+  ".item-container-header {\n" +
+  "text-transform: uppercase;\n" +
+  "}\n" +
+  ".item-container-content {\n" +
+  "border-radius: 4px;\n" +
+  "background-color: #484848;\n" +
+  "}\n" +
+  ".item {\n" +
+  "display: block;\n" +
+  "padding: 12px 10px;\n" +
+  "border-top: 1px solid #333333;\n" +
+  "}\n" +
+  ".item:first-child {\n" +
+  "border-top: none;\n" +
+  "}\n" +
+  ".item-color, .item-select, .item-toggle, .item-input-wrapper {\n" +
+  "float: right;\n" +
+  "}\n" +
+  ".item-color, .item-select, .item-input {\n" +
+  "max-width: 9em;\n" +
+  "border: none;\n" +
+  "border-radius: 3px;\n" +
+  "background-color: #333333;\n" +
+  "color: #ffffff;\n" +
+  "font-size: 0.9em;\n" +
+  "padding: 2px 5px;\n" +
+  "}\n" +
+  ".item-input {\n" +
+  "width: 4em;\n" +
+  "text-align: right;\n" +
+  "}\n" +
+  ".item-slider {\n" +
+  "width: 70%;\n" +
+  "}\n" +
+  ".item-button {\n" +
+  "width: 100%;\n" +
+  "padding: 12px;\n" +
+  "border: none;\n" +
+  "border-radius: 4px;\n" +
+  "background-color: #ff4700;\n" +
+  "color: #ffffff;\n" +
+  "font-size: 1em;\n" +
+  "text-transform: uppercase;\n" +
+  "}\n" +
+  ".title {\n" +
+  "padding: 15px 10px;\n" +
+  "text-transform: uppercase;\n" +
+  "font-family: \"PT Sans\", sans-serif;\n" +
+  "font-size: 1.2em;\n" +
+  "font-weight: 500;\n" +
+  "color: 0x888888;\n" +
+  "text-align: center;\n" +
+  "}\n" +
+  "</style><script>\n" +
+  "var bundledQuery = \"\";\n" +
+  "function getQueryParam(variable, defaultValue) {\n" +
+  "var query = (location.search || bundledQuery).substring(1);\n" +
+  "var vars = query.split(\"&\");\n" +
+  "for (var i = 0; i < vars.length; i++) {\n" +
+  "var pair = vars[i].split(\"=\");\n" +
+  "if (pair[0] === variable) {\n" +
+  "return decodeURIComponent(pair[1]);\n" +
+  "}\n" +
+  "}\n" +
+  "return defaultValue || false;\n" +
+  "}\n" +
+  "function onSubmit() {\n" +
+  "var return_to = getQueryParam(\"return_to\", \"pebblejs://close#\");" +
+  "\n" +
+  "var selectedFormat = document.getElementById(\"textFormat\").value" +
+  ";\n" +
+  "var options = {\n" +
+  "\"backgroundColor\": document.getElementById(\"backgroundColorPicke" +
+  "r\").value,\n" +
+  "\"hourHandColor\": document.getElementById(\"hourHandColorPicker\")." +
+  "value,\n" +
+  "\"minuteHandColor\": document.getElementById(\"minuteHandColorPicke" +
+  "r\").value,\n" +
+  "\"pinColor\": document.getElementById(\"pinColorPicker\").value,\n" +
+  "\"hourColor\": document.getElementById(\"hourColorPicker\").value,\n" +
+  "\"innerColor\": document.getElementById(\"innerColorPicker\").value," +
+  "\n" +
+  "\"minuteColor\": document.getElementById(\"minuteColorPicker\").valu" +
+  "e,\n" +
+  "\"textColor\": document.getElementById(\"textColorPicker\").value,\n" +
+  "\"batteryColor\": document.getElementById(\"batteryColorPicker\").va" +
+  "lue,\n" +
+  "\"batteryColor2\": document.getElementById(\"batteryColorPicker2\")." +
+  "value,\n" +
+  "\"lowBatteryLevel\": document.getElementById(\"lowBatteryLevel\").va" +
+  "lue,\n" +
+  "\"bluetoothColor\": document.getElementById(\"bluetoothColorPicker\"" +
+  ").value,\n" +
+  "\"bluetoothVibration\": document.getElementById(\"bluetoothVibratio" +
+  "n\").checked ? \"1\" : \"0\",\n" +
+  "\"bluetoothDelay\": document.getElementById(\"bluetoothDelay\").valu" +
+  "e,\n" +
+  "\"vibrationLimit\": document.getElementById(\"vibrationLimit\").valu" +
+  "e,\n" +
+  "\"textFormat\": encodeURIComponent(selectedFormat === \"%\" ? docume" +
+  "nt.getElementById(\"customFormat\").value : selectedFormat),\n" +
+  "\"textFont\": document.getElementById(\"textFont\").value,\n" +
+  "\"quietStart\": document.getElementById(\"quietStart\").value,\n" +
+  "\"quietEnd\": document.getElementById(\"quietEnd\").value,\n" +
+  "\"idleMinutes\": document.getElementById(\"idleMinutes\").value,\n" +
+  "\"secondsDuration\": document.getElementById(\"secondsDuration\").va" +
+  "lue,\n" +
+  "\"presetSwitching\": document.getElementById(\"presetSwitching\").va" +
+  "lue,\n" +
+  "\"savePreset\": document.getElementById(\"savePreset\").value,\n" +
+  "}\n" +
+  "document.location = return_to + encodeURIComponent(JSON.stringif" +
+  "y(options));\n" +
+  "}\n" +
+  "function setCustomFormatVisibility() {\n" +
+  "document.getElementById(\"customFormatElement\").style.display\n" +
+  "= (document.getElementById(\"textFormat\").value === \"%\")\n" +
+  "? \"block\" : \"none\";\n" +
+  "}\n" +
+  "</script></head><body onload=\"setCustomFormatVisibility()\"><div " +
+  "class=\"item-container\"><h1 class=\"title\">Classic Lite</h1></div>" +
+  "<div class=\"item-container\"><div class=\"item-container-header\">C" +
+  "olor Scheme</div><div class=\"item-container-content\"><label clas" +
+  "s=\"item\">\n" +
+  "Background Color\n" +
+  "<input id=\"backgroundColorPicker\" type=\"text\" class=\"item-color " +
+  "item-color-normal\" value=\"0xFFFFFF\"></label><label class=\"item\">" +
+  "\n" +
+  "Hour Hand Color\n" +
+  "<input id=\"hourHandColorPicker\" type=\"text\" class=\"item-color it" +
+  "em-color-normal\" value=\"0x000000\"></label><label class=\"item\">\n" +
+  "Minute Hand Color\n" +
+  "<input id=\"minuteHandColorPicker\" type=\"text\" class=\"item-color " +
+  "item-color-normal\" value=\"0x000000\"></label><label class=\"item\">" +
+  "\n" +
+  "Central Pin Color\n" +
+  "<input id=\"pinColorPicker\" type=\"text\" class=\"item-color item-co" +
+  "lor-normal\" value=\"0x000000\"></label><label class=\"item\">\n" +
+  "Hour Mark Color\n" +
+  "<input id=\"hourColorPicker\" type=\"text\" class=\"item-color item-c" +
+  "olor-normal\" value=\"0x000000\"></label><label class=\"item\">\n" +
+  "Inner Rectangle Color\n" +
+  "<input id=\"innerColorPicker\" type=\"text\" class=\"item-color item-" +
+  "color-normal\" value=\"0xAAAAAA\"></label><label class=\"item\">\n" +
+  "Minute Mark Color\n" +
+  "<input id=\"minuteColorPicker\" type=\"text\" class=\"item-color item" +
+  "-color-normal\" value=\"0x000000\"></label></div></div><div class=\"" +
+  "item-container\"><div class=\"item-container-header\">Low Battery W" +
+  "arning</div><div class=\"item-container-content\"><label class=\"it" +
+  "em\"><input type=\"range\" id=\"lowBatteryLevelSlider\" class=\"item-s" +
+  "lider\" name=\"lowBatteryLevel\" value=\"50\"><div class=\"item-input-" +
+  "wrapper item-slider-text\"><input type=\"text\" id=\"lowBatteryLevel" +
+  "\" class=\"item-input\" name=\"lowBatteryLevel\" value=\"50\"></div></l" +
+  "abel><label class=\"item\">\n" +
+  "Icon Color\n" +
+  "<input id=\"batteryColorPicker\" type=\"text\" class=\"item-color ite" +
+  "m-color-normal\" value=\"0x555555\"></label><label class=\"item\">\n" +
+  "Secondary Icon Color\n" +
+  "<input id=\"batteryColorPicker2\" type=\"text\" class=\"item-color it" +
+  "em-color-normal\" value=\"0x555555\"></label></div></div><div class" +
+  "=\"item-container\"><div class=\"item-container-header\">Bluetooth W" +
+  "arning</div><div class=\"item-container-content\"><label class=\"it" +
+  "em\">\n" +
+  "Icon Color\n" +
+  "<input id=\"bluetoothColorPicker\" type=\"text\" class=\"item-color i" +
+  "tem-color-normal\" value=\"0x000000\"></label><label class=\"item\">\n" +
+  "Vibration\n" +
+  "<input id=\"bluetoothVibration\" type=\"checkbox\" class=\"item-toggl" +
+  "e\" checked></label><label class=\"item\">\n" +
+  "Ignore Drops Shorter Than (seconds)\n" +
+  "<div class=\"item-input-wrapper\"><input type=\"text\" class=\"item-i" +
+  "nput\" name=\"bluetoothDelay\" id=\"bluetoothDelay\" value=\"0\"></div>" +
+  "</label><label class=\"item\">\n" +
+  "Vibrations per Hour (0 for no limit)\n" +
+  "<div class=\"item-input-wrapper\"><input type=\"text\" class=\"item-i" +
+  "nput\" name=\"vibrationLimit\" id=\"vibrationLimit\" value=\"0\"></div>" +
+  "</label></div></div><div class=\"item-container\"><div class=\"item" +
+  "-container-header\">Info Text</div><div class=\"item-container-con" +
+  "tent\"><label class=\"item\">\n" +
+  "Color\n" +
+  "<input id=\"textColorPicker\" type=\"text\" class=\"item-color item-c" +
+  "olor-normal\" value=\"0x000000\"></label><label class=\"item\">\n" +
+  "Format\n" +
+  "<select id=\"textFormat\" class=\"item-select\" onchange=\"setCustomF" +
+  "ormatVisibility()\"><option class=\"item-select-option\" value=\"\">(" +
+  "disabled)</option><option class=\"item-select-option\" value=\"Pebb" +
+  "le\">Pebble</option><option class=\"item-select-option\" value=\"%a " +
+  "%d\" selected>Sun 31</option><option class=\"item-select-option\" v" +
+  "alue=\"%d %b\">31 Jan</option><option class=\"item-select-option\" v" +
+  "alue=\"%b %d\">Jan 31</option><option class=\"item-select-option\" v" +
+  "alue=\"%d %m\">31 01</option><option class=\"item-select-option\" va" +
+  "lue=\"%m %d\">01 31</option><option class=\"item-select-option\" val" +
+  "ue=\"%a %d %m\">Sun 31 01</option><option class=\"item-select-optio" +
+  "n\" value=\"%a %m %d\">Sun 01 31</option><option class=\"item-select" +
+  "-option\" value=\"%\">(Custom)</option></select></label><label clas" +
+  "s=\"item\" id=\"customFormatElement\"><div class=\"item-input-wrapper" +
+  "\"><input type=\"text\" class=\"item-input\" name=\"customFormat\" id=\"" +
+  "customFormat\" placeholder=\"Custom Format\"></div></label><label c" +
+  "lass=\"item\">\n" +
+  "Font Size\n" +
+  "<select id=\"textFont\" class=\"item-select\"><option class=\"item-se" +
+  "lect-option\" value=\"1\" selected>14</option><option class=\"item-s" +
+  "elect-option\" value=\"2\">18</option><option class=\"item-select-op" +
+  "tion\" value=\"3\">24</option><option class=\"item-select-option\" va" +
+  "lue=\"4\">28</option></select></label></div></div><div class=\"item" +
+  "-container\"><div class=\"item-container-header\">Power Saving</div" +
+  "><div class=\"item-container-content\"><label class=\"item\">\n" +
+  "Quiet Hours Start\n" +
+  "<select id=\"quietStart\" class=\"item-select\"></select></label><la" +
+  "bel class=\"item\">\n" +
+  "Quiet Hours End\n" +
+  "<select id=\"quietEnd\" class=\"item-select\"></select></label><labe" +
+  "l class=\"item\">\n" +
+  "Idle Minutes (0 to disable)\n" +
+  "<div class=\"item-input-wrapper\"><input type=\"text\" class=\"item-i" +
+  "nput\" name=\"idleMinutes\" id=\"idleMinutes\" value=\"0\"></div></labe" +
+  "l><label class=\"item\">\n" +
+  "Seconds Hand on Tap (seconds, 0 to disable)\n" +
+  "<div class=\"item-input-wrapper\"><input type=\"text\" class=\"item-i" +
+  "nput\" name=\"secondsDuration\" id=\"secondsDuration\" value=\"0\"></di" +
+  "v></label></div><div class=\"item-container-footer\">\n" +
+  "The face ticks hourly and shows only the hands during quiet hour" +
+  "s\n" +
+  "or once the watch stayed still for the idle time. A tap brings i" +
+  "t\n" +
+  "back, along with a seconds hand for the chosen time. Use the sam" +
+  "e\n" +
+  "start and end hour to disable quiet hours.\n" +
+  "</div></div><div class=\"item-container\"><div class=\"item-contain" +
+  "er-header\">Presets</div><div class=\"item-container-content\"><lab" +
+  "el class=\"item\">\n" +
+  "Switch Presets\n" +
+  "<select id=\"presetSwitching\" class=\"item-select\"><option class=\"" +
+  "item-select-option\" value=\"0\" selected>Never</option><option cla" +
+  "ss=\"item-select-option\" value=\"1\">On Double Tap</option><option " +
+  "class=\"item-select-option\" value=\"2\">On Quiet Hours</option></se" +
+  "lect></label><label class=\"item\">\n" +
+  "Save These Settings As\n" +
+  "<select id=\"savePreset\" class=\"item-select\"><option class=\"item-" +
+  "select-option\" value=\"0\" selected>(not a preset)</option><option" +
+  " class=\"item-select-option\" value=\"1\">Preset 1 (day)</option><op" +
+  "tion class=\"item-select-option\" value=\"2\">Preset 2 (night)</opti" +
+  "on><option class=\"item-select-option\" value=\"3\">Preset 3</option" +
+  "></select></label></div><div class=\"item-container-footer\">\n" +
+  "Presets are stored on the watch, which switches between them wit" +
+  "hout\n" +
+  "the phone: a double tap moves to the next stored preset, while q" +
+  "uiet\n" +
+  "hours use the night preset and the day one otherwise.\n" +
+  "</div></div><script>\n" +
+  "[\"quietStart\", \"quietEnd\"].forEach(function(id) {\n" +
+  "var select = document.getElementById(id);\n" +
+  "for (var hour = 0; hour < 24; hour++) {\n" +
+  "var option = document.createElement(\"option\");\n" +
+  "option.className = \"item-select-option\";\n" +
+  "option.value = hour;\n" +
+  "option.text = (hour < 10 ? \"0\" : \"\") + hour + \":00\";\n" +
+  "select.appendChild(option);\n" +
+  "}\n" +
+  "});\n" +
+  "</script><div class=\"item-container\"><div class=\"button-containe" +
+  "r\"><input id=\"submitButton\" type=\"button\" class=\"item-button\" va" +
+  "lue=\"SUBMIT\" onClick=\"onSubmit()\"></div></div><script>\n" +
+  "var handColor = getQueryParam(\"hands\", \"0x000000\");\n" +
+  "document.getElementById(\"backgroundColorPicker\").value = getQuer" +
+  "yParam(\"background\", \"0xFFFFFF\");\n" +
+  "document.getElementById(\"hourHandColorPicker\").value = getQueryP" +
+  "aram(\"hhand\", handColor);\n" +
+  "document.getElementById(\"minuteHandColorPicker\").value = getQuer" +
+  "yParam(\"mhand\", handColor);\n" +
+  "document.getElementById(\"pinColorPicker\").value = getQueryParam(" +
+  "\"pin\", handColor);\n" +
+  "document.getElementById(\"hourColorPicker\").value = getQueryParam" +
+  "(\"hours\", \"0x000000\");\n" +
+  "document.getElementById(\"innerColorPicker\").value = getQueryPara" +
+  "m(\"inner\", \"0xAAAAAA\");\n" +
+  "document.getElementById(\"minuteColorPicker\").value = getQueryPar" +
+  "am(\"minutes\", \"0x000000\");\n" +
+  "document.getElementById(\"lowBatteryLevelSlider\").value =\n" +
+  "document.getElementById(\"lowBatteryLevel\").value = getQueryParam" +
+  "(\"battlvl\", \"50\");\n" +
+  "document.getElementById(\"batteryColorPicker\").value = getQueryPa" +
+  "ram(\"battcol\", \"0x555555\");\n" +
+  "document.getElementById(\"batteryColorPicker2\").value = getQueryP" +
+  "aram(\"battcol2\", \"0x555555\");\n" +
+  "document.getElementById(\"bluetoothColorPicker\").value = getQuery" +
+  "Param(\"bluetooth\", \"0x000000\");\n" +
+  "document.getElementById(\"bluetoothVibration\").checked = (parseIn" +
+  "t(getQueryParam(\"vibrate\", \"1\")) > 0);\n" +
+  "document.getElementById(\"bluetoothDelay\").value = getQueryParam(" +
+  "\"btdelay\", \"0\");\n" +
+  "document.getElementById(\"vibrationLimit\").value = getQueryParam(" +
+  "\"vibelimit\", \"0\");\n" +
+  "document.getElementById(\"textColorPicker\").value = getQueryParam" +
+  "(\"textcol\", \"0x000000\");\n" +
+  "document.getElementById(\"textFont\").value = getQueryParam(\"font\"" +
+  ", \"1\");\n" +
+  "document.getElementById(\"quietStart\").value = getQueryParam(\"qst" +
+  "art\", \"0\");\n" +
+  "document.getElementById(\"quietEnd\").value = getQueryParam(\"qend\"" +
+  ", \"0\");\n" +
+  "document.getElementById(\"idleMinutes\").value = getQueryParam(\"id" +
+  "le\", \"0\");\n" +
+  "document.getElementById(\"secondsDuration\").value = getQueryParam" +
+  "(\"seconds\", \"0\");\n" +
+  "document.getElementById(\"presetSwitching\").value = getQueryParam" +
+  "(\"presets\", \"0\");\n" +
+  "const textFmt = getQueryParam(\"textfmt\", \"Pebble\");\n" +
+  "var selectElement =  document.getElementById(\"textFormat\");\n" +
+  "selectElement.value = textFmt;\n" +
+  "if (selectElement.value !== textFmt) {\n" +
+  "selectElement.value = \"%\";\n" +
+  "document.getElementById(\"customFormat\").value = textFmt;\n" +
+  "}\n" +
+  "const versionTag = getQueryParam(\"v\");\n" +
+  "if (versionTag) {\n" +
+  "document.getElementsByTagName(\"h1\")[0].childNodes[0].nodeValue =" +
+  " \"Classic Lite \" + versionTag;\n" +
+  "}\n" +
+  "document.getElementById(\"lowBatteryLevelSlider\").oninput = funct" +
+  "ion() {\n" +
+  "document.getElementById(\"lowBatteryLevel\").value = this.value;\n" +
+  "};\n" +
+  "var slate = \"https://cdn.jsdelivr.net/gh/pebble/slate@v0.0.3/dis" +
+  "t/\";\n" +
+  "var slateStyle = document.createElement(\"link\");\n" +
+  "slateStyle.rel = \"stylesheet\";\n" +
+  "slateStyle.href = slate + \"css/slate.min.css\";\n" +
+  "document.head.appendChild(slateStyle);\n" +
+  "var slateScript = document.createElement(\"script\");\n" +
+  "slateScript.async = true;\n" +
+  "slateScript.src = slate + \"js/slate.min.js\";\n" +
+  "document.body.appendChild(slateScript);\n" +
+  "</script></body></html>\n";
+/* END config.html */
+
+/*
+ * The bundled page reads the stored settings from bundledQuery, since a
+ * data URI has no query string. The trailing comment makes some Android
+ * versions of the Pebble app open the data URI as an HTML page.
+ */
+function configPageURI(query) {
+  var page = configPage.replace('var bundledQuery = "";',
+                                "var bundledQuery = " + JSON.stringify(query) + ";");
+  return "data:text/html;charset=utf-8," + encodeURIComponent(page) + "<!--.html";
+}
+
+/* the statistics are only fetched when the user opens the settings */
 Pebble.addEventListener("showConfiguration", function() {
-  Pebble.openURL("https://cdn.rawgit.com/faelys/classic-lite/v1.4/config.html" + encodeStored(settings));
+  requestStatistics();
+  Pebble.openURL(configPageURI(encodeStored(settings)));
 });
 
 Pebble.addEventListener("webviewclosed", function(e) {
@@ -72,27 +696,20 @@ Pebble.addEventListener("webviewclosed", function(e) {
     localStorage.setItem(key, configData[key]);
   }
 
-  var dict = {
-    1: parseInt(configData["backgroundColor"]),
-    2: parseInt(configData["batteryColor"]),
-    3: parseInt(configData["bluetoothColor"]),
-    5: parseInt(configData["hourColor"]),
-    6: parseInt(configData["innerColor"]),
-    7: parseInt(configData["minuteColor"]),
-    8: parseInt(configData["textColor"]),
-    9: parseInt(configData["batteryColor2"]),
-    10: parseInt(configData["textFont"]),
-    11: configData["textFormat"],
-    12: parseInt(configData["bluetoothVibration"]),
-    13: parseInt(configData["lowBatteryLevel"]),
-    20: parseInt(configData["hourHandColor"]),
-    21: parseInt(configData["minuteHandColor"]),
-    22: parseInt(configData["pinColor"]),
-  };
+  var presetSlot = parseInt(configData["savePreset"]) || 0;
 
-  Pebble.sendAppMessage(dict, function() {
-    console.log("Send successful: " + JSON.stringify(dict));
-  }, function() {
-    console.log("Send failed!");
+  enqueueMessage({
+    kind: "config",
+    build: function() {
+      var dict = configDelta(configData);
+      if (presetSlot) {
+        dict = dict || {};
+        dict[26] = presetSlot;
+      }
+      return dict;
+    },
+    acked: function() {
+      localStorage.setItem("ackedConfig", JSON.stringify(configData));
+    },
   });
 });
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2015, Natacha Porté
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+# ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+# WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+# ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+# OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+"""Bundle config.html into src/js/pebble-js-app.js.
+
+The configuration page is minified and stored as the configPage string
+between the BEGIN and END marker lines of the JS file, which opens it as
+a data URI instead of fetching it over the network.
+Run as: python3 tools/gen-config-page.py
+"""
+
+import json
+import re
+
+PAGE = "config.html"
+SCRIPT = "src/js/pebble-js-app.js"
+
+BEGIN = "/* BEGIN config.html, generated by tools/gen-config-page.py */\n"
+END = "/* END config.html */\n"
+
+CHUNK = 64
+
+
+def minify(html):
+    """Strip indentation, blank lines and whole-line comments."""
+    lines = []
+    for line in html.splitlines():
+        line = line.strip()
+        if not line or line.startswith("//"):
+            continue
+        lines.append(line)
+    return re.sub(r">\n<", "><", "\n".join(lines) + "\n")
+
+
+def chunks(text):
+    for line in text.splitlines(True):
+        while len(line) > CHUNK:
+            yield line[:CHUNK]
+            line = line[CHUNK:]
+        yield line
+
+
+def main():
+    with open(PAGE, encoding="utf-8") as f:
+        page = minify(f.read())
+
+    body = "const configPage =\n"
+    body += " +\n".join("  " + json.dumps(c) for c in chunks(page)) + ";\n"
+
+    with open(SCRIPT, encoding="utf-8") as f:
+        script = f.read()
+    start = script.index(BEGIN) + len(BEGIN)
+    stop = script.index(END, start)
+
+    with open(SCRIPT, "w", encoding="utf-8") as f:
+        f.write(script[:start] + body + script[stop:])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2015, Natacha Porté
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+# ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+# WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+# ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+# OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+"""Generate src/geometry.h, the constant geometry of the face.
+
+The mark endpoints only depend on the screen size and on the mark insets,
+so they are computed once here with the same integer arithmetic the face
+used at run time. The hands use a quarter-wave table of the unit vector
+for their 720 possible positions.
+Run as: python3 tools/gen-geometry.py > src/geometry.h
+"""
+
+import math
+
+TRIG_MAX_ANGLE = 0x10000
+TRIG_MAX_RATIO = 0xffff
+
+RECT_SIZE = (144, 168)
+ROUND_SIZE = (180, 180)
+
+MINUTE_INSET = 5
+HOUR_OUTER_INSET = 11
+HOUR_INNER_INSET = 22
+
+HAND_POSITIONS = 720
+HAND_UNIT_SHIFT = 15
+
+
+def c_round(value):
+    return int(math.floor(value + 0.5) if value >= 0 else
+               math.ceil(value - 0.5))
+
+
+def c_div(a, b):
+    """Integer division truncating toward zero, like C."""
+    q = abs(a) // abs(b)
+    return q if (a >= 0) == (b >= 0) else -q
+
+
+def sin_lookup(angle):
+    return c_round(math.sin(angle * 2 * math.pi / TRIG_MAX_ANGLE)
+                   * TRIG_MAX_RATIO)
+
+
+def cos_lookup(angle):
+    return c_round(math.cos(angle * 2 * math.pi / TRIG_MAX_ANGLE)
+                   * TRIG_MAX_RATIO)
+
+
+def inset(rect, amount):
+    x, y, w, h = rect
+    return (x + amount, y + amount, w - 2 * amount, h - 2 * amount)
+
+
+def rect_point_at_angle(rect, angle):
+    sin_value = sin_lookup(angle)
+    cos_value = cos_lookup(angle)
+    abs_sin = abs(sin_value)
+    abs_cos = abs(cos_value)
+    width = rect[2] - 1
+    height = rect[3] - 1
+
+    horizontal = height * abs_sin < width * abs_cos
+    if horizontal:
+        x = c_div(c_div(height * sin_value, abs_cos) + width, 2)
+        y = 0 if cos_value > 0 else height
+    else:
+        x = width if sin_value > 0 else 0
+        y = c_div(height - c_div(width * cos_value, abs_sin), 2)
+
+    return (x + rect[0], y + rect[1]), int(horizontal)
+
+
+def round_point_at_angle(rect, angle):
+    x, y, width, height = rect
+    return (x + c_div(TRIG_MAX_RATIO * (width + 1)
+                      + width * sin_lookup(angle), 2 * TRIG_MAX_RATIO),
+            y + c_div(TRIG_MAX_RATIO * (height + 1)
+                      - height * cos_lookup(angle), 2 * TRIG_MAX_RATIO))
+
+
+def rect_tables():
+    bounds = (0, 0) + RECT_SIZE
+    minutes = []
+    rect = inset(bounds, MINUTE_INSET)
+    for i in range(60):
+        pt1, horiz = rect_point_at_angle(rect, TRIG_MAX_ANGLE * i // 60)
+        minutes.append(pt1 + (pt1[0] + horiz, pt1[1] + 1 - horiz))
+
+    hours = []
+    rect = inset(bounds, HOUR_OUTER_INSET)
+    rect2 = inset(bounds, HOUR_INNER_INSET)
+    for i in range(12):
+        pt1, _ = rect_point_at_angle(rect, TRIG_MAX_ANGLE * i // 12)
+        pt2, _ = rect_point_at_angle(rect2, TRIG_MAX_ANGLE * i // 12)
+        hours.append(pt1 + pt2)
+
+    return minutes, hours
+
+
+def round_tables():
+    bounds = (0, 0) + ROUND_SIZE
+    center = (bounds[2] // 2, bounds[3] // 2)
+    radius = (bounds[2] + bounds[3]) // 4
+    angle_delta = TRIG_MAX_ANGLE // (6 * radius)
+
+    minutes = []
+    rect = inset(bounds, MINUTE_INSET)
+    for i in range(60):
+        angle = TRIG_MAX_ANGLE * i // 60
+        minutes.append(round_point_at_angle(rect, angle - angle_delta)
+                       + round_point_at_angle(rect, angle + angle_delta))
+
+    hours = []
+    for i in range(12):
+        angle = TRIG_MAX_ANGLE * i // 12
+        x = sin_lookup(angle)
+        y = -cos_lookup(angle)
+        hours.append((
+            center[0] + c_div((radius - HOUR_OUTER_INSET) * x, TRIG_MAX_RATIO),
+            center[1] + c_div((radius - HOUR_OUTER_INSET) * y, TRIG_MAX_RATIO),
+            center[0] + c_div((radius - HOUR_INNER_INSET) * x, TRIG_MAX_RATIO),
+            center[1] + c_div((radius - HOUR_INNER_INSET) * y, TRIG_MAX_RATIO)))
+
+    return minutes, hours
+
+
+def hand_unit_table():
+    quarter = HAND_POSITIONS // 4
+    return [c_round(math.sin(i * 2 * math.pi / HAND_POSITIONS)
+                    * (1 << HAND_UNIT_SHIFT)) for i in range(quarter + 1)]
+
+
+def emit_table(name, rows):
+    print("static const uint8_t %s[%d][4] = {" % (name, len(rows)))
+    for i in range(0, len(rows), 3):
+        print("\t" + " ".join("{ %3d, %3d, %3d, %3d }," % row
+                              for row in rows[i:i + 3]))
+    print("};")
+
+
+def main():
+    print("/* Generated by tools/gen-geometry.py, do not edit. */")
+    print()
+    print("#define HAND_POSITIONS %d" % HAND_POSITIONS)
+    print("#define HAND_UNIT_SHIFT %d" % HAND_UNIT_SHIFT)
+    print()
+    print("/* sin(2 * pi * i / HAND_POSITIONS) << HAND_UNIT_SHIFT */")
+    unit = hand_unit_table()
+    print("static const uint16_t hand_unit[%d] = {" % len(unit))
+    for i in range(0, len(unit), 8):
+        print("\t" + " ".join("%5d," % v for v in unit[i:i + 8]))
+    print("};")
+    print()
+    print("/* mark segments as { x1, y1, x2, y2 } in window coordinates */")
+    print()
+    print("#ifdef PBL_RECT")
+    minutes, hours = rect_tables()
+    emit_table("minute_marks", minutes)
+    print()
+    emit_table("hour_marks", hours)
+    print("#else")
+    minutes, hours = round_tables()
+    emit_table("minute_marks", minutes)
+    print()
+    emit_table("hour_marks", hours)
+    print("#endif")
+
+
+if __name__ == "__main__":
+    main()